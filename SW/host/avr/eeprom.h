@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Host-side replacement of <avr/eeprom.h>: EEPROM variables are ordinary data, writes complete immediately.
+ */
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+	#include <stdint.h>
+	#include <string.h>
+
+	#define EEMEM
+	#define eeprom_is_ready() 1
+	#define eeprom_read_block(destination, source, size) memcpy((destination), (source), (size))
+	#define eeprom_update_byte(address, value) (*(uint8_t *)(address) = (value))
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Host-side replacement of <avr/interrupt.h>: an ISR is an ordinary function the simulation calls.
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+	#define ISR(vector) void vector(void); void vector(void)
+	#define sei() ((void)0)
+	#define cli() ((void)0)
+
+	// Interrupt vectors used by the firmware
+	void INT0_vect(void);
+	void ADC_vect(void);
+	void TIM0_COMPA_vect(void);
+	void TIM0_OVF_vect(void);
+	void TIM0_COMPB_vect(void);
+	void PCINT0_vect(void);
+#endif /* HOST_AVR_INTERRUPT_H_ */
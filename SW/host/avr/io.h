@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Host-side replacement of <avr/io.h> for the ATtiny13.
+ * Every I/O register is a plain variable (defined in registers.c) that the simulation can set and inspect.
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+	#include <stdint.h>
+
+	#define __AVR_ATtiny13__ 1
+
+	// I/O registers
+	extern volatile uint8_t PORTB, PINB, DDRB;
+	extern volatile uint8_t TCCR0A, TCCR0B, TIMSK0, TIFR0, OCR0A, OCR0B, TCNT0;
+	extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, ADCL, ADCH;
+	extern volatile uint8_t MCUCR, GIMSK, GIFR, PCMSK, ACSR, OSCCAL, SREG;
+	extern volatile uint16_t ADC;
+
+	#define RAMEND 0x9F
+
+	// Port B
+	#define PB0 0
+	#define PB1 1
+	#define PB2 2
+	#define PB3 3
+	#define PB4 4
+	#define PB5 5
+	#define PINB0 0
+	#define PINB1 1
+	#define PINB2 2
+	#define PINB3 3
+	#define PINB4 4
+	#define PINB5 5
+	#define DDB0 0
+	#define DDB1 1
+	#define DDB2 2
+	#define DDB3 3
+	#define DDB4 4
+	#define DDB5 5
+
+	// Timer0
+	#define WGM00 0
+	#define WGM01 1
+	#define COM0B0 4
+	#define COM0B1 5
+	#define COM0A0 6
+	#define COM0A1 7
+	#define CS00 0
+	#define CS01 1
+	#define CS02 2
+	#define WGM02 3
+	#define FOC0B 6
+	#define FOC0A 7
+	#define TOIE0 1
+	#define OCIE0A 2
+	#define OCIE0B 3
+	#define TOV0 1
+	#define OCF0A 2
+	#define OCF0B 3
+
+	// ADC
+	#define MUX0 0
+	#define MUX1 1
+	#define ADLAR 5
+	#define REFS0 6
+	#define ADPS0 0
+	#define ADPS1 1
+	#define ADPS2 2
+	#define ADIE 3
+	#define ADIF 4
+	#define ADATE 5
+	#define ADSC 6
+	#define ADEN 7
+	#define ADTS0 0
+	#define ADTS1 1
+	#define ADTS2 2
+	#define ACME 6
+	#define ADC1D 2
+	#define ADC3D 3
+	#define ADC2D 4
+	#define ADC0D 5
+	#define ACD 7
+
+	// External interrupts, sleep
+	#define ISC00 0
+	#define ISC01 1
+	#define SM0 3
+	#define SM1 4
+	#define SE 5
+	#define PUD 6
+	#define PCIE 5
+	#define INT0 6
+	#define PCIF 5
+	#define INTF0 6
+	#define PCINT0 0
+	#define PCINT1 1
+	#define PCINT2 2
+	#define PCINT3 3
+	#define PCINT4 4
+
+	#define _BV(bit) (1 << (bit))
+#endif /* HOST_AVR_IO_H_ */
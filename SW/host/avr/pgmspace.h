@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Host-side replacement of <avr/pgmspace.h>: flash tables are ordinary constant data.
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+	#include <stdint.h>
+	#include <string.h>
+
+	#define PROGMEM
+	#define pgm_read_byte(address) (*(const uint8_t *)(address))
+	#define pgm_read_word(address) HostReadWord(address)
+
+	/// Read a 16-bit word from any table (memcpy, the tables hold unsigned or struct members, not uint16_t)
+	static inline uint16_t HostReadWord(const void *address)
+	{
+		uint16_t word;
+		memcpy(&word, address, sizeof(word));
+		return word;
+	}
+#endif /* HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Host-side replacement of <avr/sleep.h>: sleeping does nothing.
+ */
+
+#ifndef HOST_AVR_SLEEP_H_
+#define HOST_AVR_SLEEP_H_
+	#define SLEEP_MODE_IDLE 0
+	#define SLEEP_MODE_ADC  1
+	#define set_sleep_mode(mode) ((void)(mode))
+	#define sleep_enable()  ((void)0)
+	#define sleep_disable() ((void)0)
+	#define sleep_cpu()     ((void)0)
+#endif /* HOST_AVR_SLEEP_H_ */
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+#include <avr/io.h>
+
+/// Simulated I/O registers of the ATtiny13
+volatile uint8_t PORTB, PINB, DDRB;
+volatile uint8_t TCCR0A, TCCR0B, TIMSK0, TIFR0, OCR0A, OCR0B, TCNT0;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, ADCL, ADCH;
+volatile uint8_t MCUCR, GIMSK, GIFR, PCMSK, ACSR, OSCCAL, SREG;
+volatile uint16_t ADC;
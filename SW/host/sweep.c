@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Host-side timing sweep of the firmware.
+ *
+ * functions.c and the ISRs of main.c are compiled against the simulated registers (registers.c).
+ * For every ADC value 0–1023 the ADC interrupt and the zero-cross interrupt are executed,
+ * the programmed timer is read back and the compare interrupt is run until the end of the trigger pulse.
+ * One line per ADC value is printed: chosen prescaler, OCR0A value, firing delay, ideal delay
+ * (linear mapping without any quantization) and the quantization error. With USE_PERIOD_MEASUREMENT a mains
+ * frequency sweep of MeasurePeriod() follows. The output is compared against a golden table by "make check".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "functions.h"
+
+// Firmware globals (main.c)
+extern unsigned ADCResult;
+#if USE_LOOKUP_TABLE
+extern volatile unsigned char SetpointPercent;
+#elif USE_BURST_FIRE
+extern volatile unsigned char BurstFirePercent;
+#endif
+
+#if USE_HW_OC0A
+/// Level of PB0 driven by the OC0A compare output and the timebase value of its last change
+static int OC0ALevel;
+static unsigned OC0AEdge;
+#endif
+
+#if USE_STACK_MONITOR
+/**
+ * @brief Replacement of StackUnused(), the stack painting of functions.c only exists on the target.
+ */
+unsigned StackUnused(void)
+{
+	return 0;
+}
+#endif
+
+/**
+ * @brief Reset the simulated registers to their state after PinsInit() and TimerInit().
+ */
+static void ResetRegisters(void)
+{
+	PORTB = PINB = DDRB = 0;
+	TCCR0A = TCCR0B = TIMSK0 = TIFR0 = OCR0A = OCR0B = TCNT0 = 0;
+	ADMUX = ADCSRA = ADCSRB = DIDR0 = ADCL = ADCH = 0;
+	MCUCR = GIMSK = GIFR = 0;
+	ADC = 0;
+	PinsInit();
+	TimerInit();
+#if USE_FREE_RUNNING_TIMER
+	TimebaseHigh = 0;
+#endif
+#if USE_HW_OC0A
+	OC0ALevel = 0;
+	OC0AEdge = 0;
+#endif
+}
+
+/**
+ * @brief Compare match of TCNT0 at the given time: the OC0A compare output acts first, then the ISR runs.
+ */
+static void CompareMatch(unsigned time)
+{
+#if USE_HW_OC0A
+	if ((TCCR0A & (1 << COM0A1)) && (OC0ALevel != ((TCCR0A & (1 << COM0A0)) != 0)))
+	{
+		OC0ALevel = !OC0ALevel;
+		OC0AEdge = time;
+	}
+#endif
+	TIM0_COMPA_vect();
+}
+
+#if !USE_FREE_RUNNING_TIMER
+/**
+ * @brief Prescaler selected by the clock select bits of TCCR0B.
+ */
+static unsigned Prescaler(void)
+{
+	switch (TCCR0B & ((1 << CS00) | (1 << CS01) | (1 << CS02)))
+	{
+		case TIMER_CLOCK_PRESC_8:
+			return 8;
+		case TIMER_CLOCK_PRESC_64:
+			return 64;
+		case TIMER_CLOCK_PRESC_256:
+			return 256;
+		case TIMER_CLOCK_PRESC_1024:
+			return 1024;
+	}
+	return 0;
+}
+#endif
+
+/**
+ * @brief State of the optotriac output (PB0), including the OC0A compare output.
+ */
+static int OutputHigh(void)
+{
+#if USE_HW_OC0A
+	return OC0ALevel;
+#else
+	return (PORTB & (1 << PB0)) != 0;
+#endif
+}
+
+#if USE_FREE_RUNNING_TIMER
+/**
+ * @brief Advance the timebase to the scheduled event and run the compare interrupt.
+ */
+static void RunToEvent(void)
+{
+	// Matches in the earlier wraps of TCNT0 must be ignored by the ISR, which sees them one tick late (interrupt latency)
+	unsigned time = TimebaseEvent;
+	for (unsigned wraps = (time - TimebaseNow() - 1) / TIMEBASE_WRAP; wraps > 0; wraps--)
+	{
+		unsigned match = time - wraps * TIMEBASE_WRAP;
+		TimebaseHigh = (unsigned char)((match + 1) >> 8);
+		TCNT0 = (unsigned char)(match + 1);
+		CompareMatch(match);
+	}
+	TimebaseHigh = (unsigned char)(time >> 8);
+	TCNT0 = (unsigned char)time;
+	CompareMatch(time);
+}
+#endif
+
+#if USE_EQUAL_POWER
+/**
+ * @brief Conduction fraction of the half period delivering the given fraction of the full power (resistive load).
+ */
+static double EqualPowerConduction(double power)
+{
+	double low = 0.0, high = M_PI;
+	for (int i = 0; i < 60; i++)
+	{
+		double angle = (low + high) / 2;
+		if (1.0 - angle / M_PI + sin(2 * angle) / (2 * M_PI) > power)
+		{
+			low = angle;
+		}
+		else
+		{
+			high = angle;
+		}
+	}
+	return 1.0 - (low + high) / 2 / M_PI;
+}
+#endif
+
+/**
+ * @brief Ideal firing delay of the linear (or equal-power) mapping, without quantization.
+ * 
+ * @return double Delay in µs, negative if the output stays OFF.
+ */
+static double IdealDelay(unsigned ADCValue)
+{
+	if (ADCValue > UPPER_THRESHOLD_VALUE)
+	{
+		return ZERO_CROSS_DELAY_US;
+	}
+	if (ADCValue < LOWER_THRESHOLD_VALUE)
+	{
+		return -1.0;
+	}
+	double fraction = (double)(ADCValue - MIN_ADC_VALUE) / ADC_RANGE_VALUE;
+#if USE_EQUAL_POWER
+	fraction = EqualPowerConduction(fraction);
+#endif
+	if (fraction * HALF_PERIOD_DURATION_US + ZERO_CROSS_DELAY_US >= HALF_PERIOD_DURATION_US)
+	{
+		// Full conduction, fired right at the zero crossing
+		return ZERO_CROSS_DELAY_US;
+	}
+	return HALF_PERIOD_DURATION_US - ZERO_CROSS_DELAY_US - fraction * HALF_PERIOD_DURATION_US;
+}
+
+#if USE_PERIOD_MEASUREMENT
+/**
+ * @brief Mains frequency sweep of MeasurePeriod() and of the delay calculation from the measured half period.
+ * 
+ * For every frequency from MAINS_MIN_FREQUENCY_HZ to MAINS_MAX_FREQUENCY_HZ 64 zero-cross pulses are run through INT0,
+ * their timestamps wrap at 16 bits as the timebase of the target does. One line per frequency: filtered and ideal
+ * half period, the delay at 80% from CalculateDelay() (and from CalculateDelayFromADC() with USE_HIGH_RESOLUTION)
+ * and its ideal value, all in ticks. The longest half period (MAINS_MIN_FREQUENCY_HZ) shows an overflow of the
+ * 16-bit filter state or of the 32-bit delay products.
+ */
+static void MainsSweep(void)
+{
+	double edge = 0, maxError = 0;
+	printf("# mains_hz half_ticks ideal_ticks delay_80 ideal_80 delay_adc_80 ideal_adc_80\n");
+	for (unsigned frequency = MAINS_MIN_FREQUENCY_HZ; frequency <= MAINS_MAX_FREQUENCY_HZ; frequency++)
+	{
+		double half = F_CPU / (double)TIMEBASE_PRESCALER / (2.0 * frequency);
+		for (unsigned i = 0; i < 64; i++)
+		{
+			edge += half;
+			uint16_t time = (uint16_t)lround(edge);
+			TimebaseHigh = (unsigned char)(time >> 8);
+			TCNT0 = (unsigned char)time;
+			INT0_vect();
+		}
+
+		double ideal = half - ZERO_CROSS_DELAY_TICKS - 0.8 * half;
+		unsigned delay = CalculateDelay(80);
+		double error = fabs(delay - ideal);
+	#if USE_HIGH_RESOLUTION
+		// 80% of the ADC range above MIN_ADC_VALUE
+		unsigned ADCValue = MIN_ADC_VALUE + (ADC_RANGE_VALUE * 4 + 2) / 5;
+		double idealADC = half - ZERO_CROSS_DELAY_TICKS - (double)(ADCValue - MIN_ADC_VALUE) / ADC_RANGE_VALUE * half;
+		unsigned delayADC = CalculateDelayFromADC(ADCValue);
+		error = fmax(error, fabs(delayADC - idealADC));
+	#else
+		double idealADC = -1.0;
+		unsigned delayADC = 0;
+	#endif
+		error = fmax(error, fabs(HalfPeriodTicks - half));
+		maxError = fmax(maxError, error);
+		printf("%4u %6u %8.1f %6u %8.1f %6u %8.1f\n", frequency, HalfPeriodTicks, half, delay, ideal, delayADC, idealADC);
+	}
+	printf("# max |error| %.1f ticks\n", maxError);
+}
+#endif
+
+int main(void)
+{
+	unsigned count[1025] = { 0 };
+	double maxError = 0, sumError = 0;
+	unsigned fired = 0;
+
+	printf("# adc prescaler ocr0a delay_us ideal_us error_us pulse_us\n");
+	for (unsigned value = 0; value < 1024; value++)
+	{
+		ResetRegisters();
+		// Steady input: let the ADC interrupt fill all its filter stages with the same value
+		for (unsigned i = 0; i < ADC_OVERSAMPLING_COUNT * ADC_AVERAGE_COUNT; i++)
+		{
+			ADC = (uint16_t)value;
+			ADC_vect();
+		}
+#if USE_LOOKUP_TABLE
+		// Done by the main loop in the firmware
+		SetpointPercent = (unsigned char)CalculateADCValue(ADCResult);
+#elif USE_BURST_FIRE
+		BurstFirePercent = (unsigned char)CalculateADCValue(ADCResult);
+#endif
+		INT0_vect();
+
+		double ideal = IdealDelay(value);
+		unsigned prescaler = 0, ocr = 0;
+		double delay = -1.0, pulse = 0.0;
+		if (TIMSK0 & (1 << OCIE0A))
+		{
+			ocr = OCR0A;
+#if USE_FREE_RUNNING_TIMER
+			prescaler = TIMEBASE_PRESCALER;
+			unsigned fire = TimebaseEvent;
+			delay = fire * (double)TIMEBASE_PRESCALER * 1e6 / F_CPU;
+			RunToEvent();
+			if (OutputHigh())
+			{
+				RunToEvent();
+	#if USE_HW_OC0A
+				// A wrong compare output mode ends the pulse at some other match
+				pulse = (OC0AEdge - fire) * (double)TIMEBASE_PRESCALER * 1e6 / F_CPU;
+	#else
+				pulse = (TimebaseEvent - fire) * (double)TIMEBASE_PRESCALER * 1e6 / F_CPU;
+	#endif
+			}
+#else
+			prescaler = Prescaler();
+			// OCR0A = TCNT0 + OCValue, where OCValue = ticks - 1 (see CalculateRegisterValue())
+			delay = ((unsigned char)(OCR0A - TCNT0) + 1) * (double)prescaler * 1e6 / F_CPU;
+			CompareMatch(0);
+			if (OutputHigh())
+			{
+				pulse = ((unsigned char)(OCR0A - TCNT0) + 1) * (double)Prescaler() * 1e6 / F_CPU;
+				CompareMatch(0);
+			}
+#endif
+			if (OutputHigh())
+			{
+				// The trigger pulse has not been ended
+				pulse = -pulse;
+			}
+		}
+
+		double error = 0.0;
+		if ((delay >= 0) != (ideal >= 0))
+		{
+			// Fires although it should not (or the other way round)
+			error = 1e6;
+		}
+		else if (delay >= 0)
+		{
+			error = delay - ideal;
+			fired++;
+		}
+		if (error < 0 ? -error > maxError : error > maxError)
+		{
+			maxError = error < 0 ? -error : error;
+		}
+		sumError += error;
+		count[prescaler]++;
+		printf("%4u %3u %3u %8.1f %8.1f %7.1f %6.1f\n", value, prescaler, ocr,
+			delay, ideal, error, pulse);
+	}
+	printf("# fired %u, off %u, prescaler 8: %u, 64: %u, 256: %u, 1024: %u\n", fired, count[0], count[8], count[64], count[256], count[1024]);
+	printf("# max |error| %.1f us, mean error %.2f us\n", maxError, fired ? sumError / fired : 0.0);
+#if USE_PERIOD_MEASUREMENT
+	MainsSweep();
+#endif
+	return 0;
+}
@@ -10,15 +10,341 @@
 #define FUNCTIONS_H_
 	#include <avr/io.h>
 	#include <avr/interrupt.h>
+	#include <avr/pgmspace.h>
+	#include <avr/eeprom.h>
+	#include "hal.h"
+	#include "power_table.h"
+
+	// Build options (0 = disabled, 1 = enabled); can be overridden from the project symbols, e.g. USE_LOOKUP_TABLE=1
+	#ifndef USE_LOOKUP_TABLE
+	#define USE_LOOKUP_TABLE 0	// Timer settings for every 0–100% step are precomputed in flash, INT0 only does a table lookup
+	#endif
+	#ifndef USE_EQUAL_POWER
+	#define USE_EQUAL_POWER 0	// Lookup table maps every 1% setpoint step to an equal step of the delivered power (see power_table.h)
+	#endif
+	#ifndef USE_SOFT_START
+	#define USE_SOFT_START 0	// The firing delay may only decrease by SOFT_START_STEP_US per half-period (power-on and setpoint steps)
+	#endif
+	#ifndef SOFT_START_STEP_US
+	#define SOFT_START_STEP_US 50	// Maximum decrease of the firing delay per half-period (50 µs = full power in 1.8 s at 50 Hz)
+	#endif
+	#ifndef USE_BURST_FIRE
+	#define USE_BURST_FIRE BURST_FIRE_OFF	// Integral-cycle control: whole mains cycles are fired or skipped (see BURST_FIRE_...)
+	#endif
+	#define BURST_FIRE_OFF    0	// Phase-angle control only
+	#define BURST_FIRE_ALWAYS 1	// Burst-fire mode only
+	#define BURST_FIRE_BY_PIN 2	// Burst-fire mode while BURST_FIRE_PIN is pulled low (jumper to GND), phase-angle control otherwise
+	#ifndef BURST_FIRE_PIN
+	#define BURST_FIRE_PIN PB2	// Spare pin selecting the mode with BURST_FIRE_BY_PIN (PB2 or PB4, internal pull-up)
+	#endif
+	#ifndef USE_BOTH_EDGES
+	#define USE_BOTH_EDGES 0	// INT0 on any change of the zero-detect signal, each half-period is timed from its own edge
+	#endif
+	#ifndef ZERO_CROSS_OFFSET_POSITIVE_US
+	#define ZERO_CROSS_OFFSET_POSITIVE_US 0	// Correction of the delay after the rising edge (positive half-period) with USE_BOTH_EDGES, µs
+	#endif
+	#ifndef ZERO_CROSS_OFFSET_NEGATIVE_US
+	#define ZERO_CROSS_OFFSET_NEGATIVE_US 0	// Correction of the delay after the falling edge (negative half-period) with USE_BOTH_EDGES, µs
+	#endif
+	#ifndef USE_ZERO_CROSS_CALIBRATION
+	#define USE_ZERO_CROSS_CALIBRATION 0	// Offset from the zero crossing to the INT0 edge is measured at startup instead of ZERO_CROSS_DELAY_US
+	#endif
+	#ifndef USE_PULSE_TRAIN
+	#define USE_PULSE_TRAIN 0		// Up to PULSE_TRAIN_COUNT short trigger pulses per half-period instead of one, for loads that latch late (motors)
+	#endif
+	#ifndef PULSE_TRAIN_COUNT
+	#define PULSE_TRAIN_COUNT 8		// Maximum number of pulses in one half-period with USE_PULSE_TRAIN
+	#endif
+	#ifndef PULSE_TRAIN_PULSE_US
+	#define PULSE_TRAIN_PULSE_US 100	// Duration of one pulse of the train, µs
+	#endif
+	#ifndef PULSE_TRAIN_GAP_US
+	#define PULSE_TRAIN_GAP_US 200	// Time between two pulses of the train, µs
+	#endif
+	#ifndef USE_DIP_SWITCH
+	#define USE_DIP_SWITCH 0		// Setpoint from a 3-way DIP switch on PB2–PB4 (to GND) through DIP_SWITCH_TABLE, the ADC is not used
+	#endif
+	#ifndef DIP_SWITCH_TABLE
+	// Power level (%) of the DIP switch positions 0–7 (PB2 = bit 0, PB3 = bit 1, PB4 = bit 2, switch closed = 1)
+	#define DIP_SWITCH_TABLE(ENTRY) ENTRY(0) ENTRY(10) ENTRY(20) ENTRY(35) ENTRY(50) ENTRY(60) ENTRY(70) ENTRY(100)
+	#endif
+	#ifndef USE_HW_OC0A
+	#define USE_HW_OC0A 0		// Trigger pulse edges on PB0 (OC0A) are generated by Timer0 compare match instead of the ISR
+	#endif
+	#ifndef USE_FREE_RUNNING_TIMER
+	#define USE_FREE_RUNNING_TIMER HAL_ATMEGA8	// Timer0 runs continuously with one prescaler, all events are compare targets on one timebase (always on the ATmega8)
+	#endif
+	#ifndef USE_HIGH_RESOLUTION
+	#define USE_HIGH_RESOLUTION 0	// ADC value is mapped straight to the firing delay, without the 0–100% stage
+	#endif
+	#ifndef USE_PERIOD_MEASUREMENT
+	#define USE_PERIOD_MEASUREMENT 0	// Mains half period is measured from the zero-cross pulses (50/60 Hz), all timing is scaled from it
+	#endif
+	#ifndef USE_ZERO_CROSS_PLL
+	#define USE_ZERO_CROSS_PLL 0	// Zero-cross edges are filtered by a software PLL: edges outside of the window are ignored, missed ones are predicted
+	#endif
+	#ifndef USE_OSCCAL_TRIM
+	#define USE_OSCCAL_TRIM 0		// OSCCAL is trimmed in the main loop so that the measured half period matches 50 or 60 Hz
+	#endif
+	#ifndef USE_FAST_STARTUP
+	#define USE_FAST_STARTUP 0		// No firing until the mains period is locked, calibration is restored from and saved to EEPROM
+	#endif
+	#ifndef USE_SETPOINT_CACHE
+	#define USE_SETPOINT_CACHE 0	// Hysteresis of ADC_DEADBAND on the ADC value, the delay and timer setting are only recalculated when it moves
+	#endif
+	#ifndef ADC_DEADBAND
+	#define ADC_DEADBAND 2			// Changes of the ADC value up to this many LSB are ignored with USE_SETPOINT_CACHE
+	#endif
+	#ifndef USE_SPEED_CONTROL
+	#define USE_SPEED_CONTROL 0		// Closed-loop motor speed: the pot sets the speed, a PI controller sets the power from the tachometer on TACHO_PIN
+	#endif
+	#ifndef TACHO_PIN
+	#define TACHO_PIN PB2			// Spare pin of the tachometer / hall sensor with USE_SPEED_CONTROL (PB2 or PB4, pin change interrupt)
+	#endif
+	#ifndef TACHO_FULL_SPEED_PERIOD_US
+	#define TACHO_FULL_SPEED_PERIOD_US 2000	// Period of the tachometer pulses at 100% speed, µs (e.g. 2 pulses per revolution at 15000 rpm)
+	#endif
+	#ifndef SPEED_KP
+	#define SPEED_KP 128			// Proportional gain of the speed controller in 1/256 % power per % speed error
+	#endif
+	#ifndef SPEED_KI
+	#define SPEED_KI 8				// Integral gain of the speed controller in 1/256 % power per % speed error and half-period
+	#endif
+	#ifndef USE_OVERCURRENT
+	#define USE_OVERCURRENT 0		// Current-sense shunt on ADC channel OVERCURRENT_CHANNEL, firing is inhibited when it exceeds OVERCURRENT_THRESHOLD
+	#endif
+	#ifndef OVERCURRENT_CHANNEL
+	#define OVERCURRENT_CHANNEL 2	// ADC channel of the current sense with USE_OVERCURRENT: 1 = ADC1 (PB2), 2 = ADC2 (PB4)
+	#endif
+	#ifndef OVERCURRENT_THRESHOLD
+	#define OVERCURRENT_THRESHOLD 800	// ADC value of the current sense that trips the protection
+	#endif
+	#ifndef OVERCURRENT_BACKOFF
+	#define OVERCURRENT_BACKOFF 100	// Half-periods without firing after a trip (100 = 1 s at 50 Hz)
+	#endif
+	#ifndef USE_STACK_MONITOR
+	#define USE_STACK_MONITOR 0		// Unused SRAM is painted with STACK_CANARY at reset, StackUnused() (and the telemetry frame) gives the stack headroom
+	#endif
+	#ifndef MAINS_FREQUENCY_HZ
+	#define MAINS_FREQUENCY_HZ 50	// Nominal mains frequency (45–65 Hz), all timing constants of the half period are derived from it
+	#endif
+	#ifndef ZERO_CROSS_DELAY_US
+	#define ZERO_CROSS_DELAY_US 1000	// Time delay from the zero-detect pulse to the actual zero crossing (detector offset, µs)
+	#endif
+	#ifndef USE_SLEEP
+	#define USE_SLEEP 0				// Main loop puts the CPU into Idle sleep mode between interrupts
+	#endif
+	#ifndef USE_ADC_NOISE_REDUCTION
+	#define USE_ADC_NOISE_REDUCTION 0	// ADC conversion runs in ADC Noise Reduction sleep mode while the timer is not needed
+	#endif
+	#ifndef USE_FIXED_POINT
+	#define USE_FIXED_POINT 0		// CalculateADCValue() and CalculateRegisterValue() use 16-bit multiply-and-shift instead of 32-bit division
+	#endif
+	#ifndef ADC_OVERSAMPLING_SHIFT
+	#define ADC_OVERSAMPLING_SHIFT 0	// 2^n conversions are chained and summed in every half-period (0 = one conversion)
+	#endif
+	#ifndef ADC_AVERAGE_SHIFT
+	#define ADC_AVERAGE_SHIFT 0		// Moving average over the sums of the last 2^n half-periods (ring buffer in SRAM, 0 = off)
+	#endif
+	#ifndef USE_INSTRUMENTATION
+	#define USE_INSTRUMENTATION 0	// Spare pin INSTRUMENTATION_PIN is high while an ISR runs, with a short low notch at the trigger instant
+	#endif
+	#ifndef INSTRUMENTATION_PIN
+	#define INSTRUMENTATION_PIN PB2	// Spare pin used by USE_INSTRUMENTATION (PB2 or PB4)
+	#endif
+	#ifndef USE_TELEMETRY
+	#define USE_TELEMETRY 0			// Binary status frames are sent by a transmit-only software UART on TELEMETRY_PIN (uses OCR0B)
+	#endif
+	#ifndef TELEMETRY_PIN
+	#define TELEMETRY_PIN PB4		// Spare pin used by USE_TELEMETRY (PB2 or PB4)
+	#endif
+	#ifndef TELEMETRY_BAUD
+	#define TELEMETRY_BAUD 9600		// Bit rate of the telemetry UART (8N1)
+	#endif
+	#ifndef TELEMETRY_INTERVAL
+	#define TELEMETRY_INTERVAL 10	// Minimum number of half-periods between two telemetry frames
+	#endif
+	#ifndef ADC_AUTO_TRIGGER
+	#define ADC_AUTO_TRIGGER ADC_TRIGGER_SOFTWARE	// Source starting the ADC conversion in every half-period (see ADC_TRIGGER_...)
+	#endif
+	#define ADC_TRIGGER_SOFTWARE 0	// ADCStart() in INT0 ISR
+	#define ADC_TRIGGER_INT0     1	// Hardware auto-trigger on the external interrupt request 0 (zero-cross edge)
+	#define ADC_TRIGGER_TIMER0   2	// Hardware auto-trigger on Timer0 compare match B, ADC_TRIGGER_PHASE_US after the edge (USE_FREE_RUNNING_TIMER)
+
+	#if USE_EQUAL_POWER && !USE_LOOKUP_TABLE
+	#error "USE_EQUAL_POWER requires USE_LOOKUP_TABLE (the firing angles are precomputed into the table)"
+	#endif
+	// The tables of the legacy timer path hold the prescaler and OCR0A of every entry, there is no delay to be corrected
+	#if (USE_LOOKUP_TABLE || USE_DIP_SWITCH) && (USE_SOFT_START || USE_BOTH_EDGES || USE_ZERO_CROSS_CALIBRATION) && !USE_FREE_RUNNING_TIMER
+	#error "USE_SOFT_START, USE_BOTH_EDGES and USE_ZERO_CROSS_CALIBRATION correct the firing delay, with USE_LOOKUP_TABLE or USE_DIP_SWITCH they require USE_FREE_RUNNING_TIMER (its tables hold delays)"
+	#endif
+	#if USE_ZERO_CROSS_CALIBRATION && USE_BOTH_EDGES
+	#error "USE_ZERO_CROSS_CALIBRATION cannot be combined with USE_BOTH_EDGES (the detector gives no pulse around the zero crossing)"
+	#endif
+	#if USE_PULSE_TRAIN && !USE_FREE_RUNNING_TIMER
+	#error "USE_PULSE_TRAIN requires USE_FREE_RUNNING_TIMER (the end of the half-cycle is a deadline on the timebase)"
+	#endif
+	#if USE_DIP_SWITCH && (USE_LOOKUP_TABLE || USE_HIGH_RESOLUTION || USE_SETPOINT_CACHE || USE_SPEED_CONTROL || USE_OVERCURRENT || USE_BURST_FIRE)
+	#error "USE_DIP_SWITCH cannot be combined with options using the ADC (USE_LOOKUP_TABLE, USE_HIGH_RESOLUTION, USE_SETPOINT_CACHE, USE_SPEED_CONTROL, USE_OVERCURRENT, USE_BURST_FIRE)"
+	#endif
+	#if USE_DIP_SWITCH && (ADC_AUTO_TRIGGER || USE_ADC_NOISE_REDUCTION || ADC_OVERSAMPLING_SHIFT || ADC_AVERAGE_SHIFT)
+	#error "USE_DIP_SWITCH cannot be combined with the ADC options (the ADC is not used)"
+	#endif
+	#if USE_DIP_SWITCH && (USE_INSTRUMENTATION || USE_TELEMETRY)
+	#error "USE_DIP_SWITCH uses all spare pins (PB2–PB4), USE_INSTRUMENTATION and USE_TELEMETRY are not available"
+	#endif
+	#if USE_HIGH_RESOLUTION && USE_LOOKUP_TABLE
+	#error "USE_HIGH_RESOLUTION cannot be combined with USE_LOOKUP_TABLE (the table has 1% steps)"
+	#endif
+	#if USE_PERIOD_MEASUREMENT && !USE_FREE_RUNNING_TIMER
+	#error "USE_PERIOD_MEASUREMENT requires USE_FREE_RUNNING_TIMER (the zero-cross pulses are timestamped on the timebase)"
+	#endif
+	#if USE_ZERO_CROSS_PLL && !USE_FREE_RUNNING_TIMER
+	#error "USE_ZERO_CROSS_PLL requires USE_FREE_RUNNING_TIMER (the edges are timestamped on the timebase)"
+	#endif
+	#if USE_OSCCAL_TRIM && !USE_PERIOD_MEASUREMENT
+	#error "USE_OSCCAL_TRIM requires USE_PERIOD_MEASUREMENT (the mains period is the frequency reference)"
+	#endif
+	#if USE_FAST_STARTUP && !USE_PERIOD_MEASUREMENT
+	#error "USE_FAST_STARTUP requires USE_PERIOD_MEASUREMENT (the lock is detected on the measured half periods)"
+	#endif
+	#if USE_SPEED_CONTROL && !USE_FREE_RUNNING_TIMER
+	#error "USE_SPEED_CONTROL requires USE_FREE_RUNNING_TIMER (the tachometer pulses are timestamped on the timebase)"
+	#endif
+	#if USE_SPEED_CONTROL && (USE_LOOKUP_TABLE || USE_HIGH_RESOLUTION || USE_SETPOINT_CACHE)
+	#error "USE_SPEED_CONTROL cannot be combined with USE_LOOKUP_TABLE, USE_HIGH_RESOLUTION or USE_SETPOINT_CACHE (the power comes from the controller)"
+	#endif
+	#if USE_OVERCURRENT && (ADC_AUTO_TRIGGER || USE_ADC_NOISE_REDUCTION)
+	#error "USE_OVERCURRENT requires ADC_TRIGGER_SOFTWARE without USE_ADC_NOISE_REDUCTION (the ADC alternates between the pot and the current sense)"
+	#endif
+	#if USE_OVERCURRENT && ((OVERCURRENT_BACKOFF < 1) || (OVERCURRENT_BACKOFF > 255))
+	#error "OVERCURRENT_BACKOFF must be 1 to 255"
+	#endif
+	#if USE_PERIOD_MEASUREMENT && USE_LOOKUP_TABLE
+	#error "USE_PERIOD_MEASUREMENT cannot be combined with USE_LOOKUP_TABLE (the table is calculated for HALF_PERIOD_DURATION_US)"
+	#endif
+	#if (ADC_OVERSAMPLING_SHIFT + ADC_AVERAGE_SHIFT) > 6
+	#error "ADC_OVERSAMPLING_SHIFT + ADC_AVERAGE_SHIFT must not exceed 6 (the running sum of 10-bit values must fit 16 bits)"
+	#endif
+	#if !HAL_ATMEGA8 && (ADC_AVERAGE_SHIFT > 3)
+	#error "ADC_AVERAGE_SHIFT must not exceed 3 on the ATtiny13 (the ring buffer of 16-bit sums takes 2^n * 2 bytes of the 64 B SRAM)"
+	#endif
+	#if ADC_OVERSAMPLING_SHIFT && USE_ADC_NOISE_REDUCTION
+	#error "ADC_OVERSAMPLING_SHIFT cannot be combined with USE_ADC_NOISE_REDUCTION (only one conversion per sleep)"
+	#endif
+	#if (ADC_AUTO_TRIGGER == ADC_TRIGGER_TIMER0) && !USE_FREE_RUNNING_TIMER
+	#error "ADC_TRIGGER_TIMER0 requires USE_FREE_RUNNING_TIMER (Timer0 is restarted for every event otherwise)"
+	#endif
+	#if ADC_AUTO_TRIGGER && USE_ADC_NOISE_REDUCTION
+	#error "ADC_AUTO_TRIGGER cannot be combined with USE_ADC_NOISE_REDUCTION (the conversion is started by the sleep instruction)"
+	#endif
+	#if USE_ADC_NOISE_REDUCTION && !USE_SLEEP
+	#error "USE_ADC_NOISE_REDUCTION requires USE_SLEEP"
+	#endif
+	#if USE_ADC_NOISE_REDUCTION && USE_FREE_RUNNING_TIMER
+	#error "USE_ADC_NOISE_REDUCTION cannot be combined with USE_FREE_RUNNING_TIMER (Timer0 stops in ADC Noise Reduction mode)"
+	#endif
+
+	#if HAL_ATMEGA8 && !USE_FREE_RUNNING_TIMER
+	#error "The ATmega8 build requires USE_FREE_RUNNING_TIMER (Timer1 runs with a single prescaler)"
+	#endif
+	#if HAL_ATMEGA8 && (USE_BOTH_EDGES || USE_ZERO_CROSS_CALIBRATION || USE_ZERO_CROSS_PLL)
+	#error "USE_BOTH_EDGES, USE_ZERO_CROSS_CALIBRATION and USE_ZERO_CROSS_PLL are not available on the ATmega8 (the zero cross is the rising-edge input capture of Timer1)"
+	#endif
+	#if HAL_ATMEGA8 && (USE_SPEED_CONTROL || USE_OVERCURRENT || ADC_AUTO_TRIGGER)
+	#error "USE_SPEED_CONTROL, USE_OVERCURRENT and ADC_AUTO_TRIGGER are not available on the ATmega8 (no pin change interrupt, other ADC channels and trigger sources)"
+	#endif
+
+	#if USE_INSTRUMENTATION && (INSTRUMENTATION_PIN != PB2) && (INSTRUMENTATION_PIN != PB4)
+	#error "INSTRUMENTATION_PIN must be one of the spare pins PB2 or PB4"
+	#endif
+	#if USE_TELEMETRY && !USE_FREE_RUNNING_TIMER
+	#error "USE_TELEMETRY requires USE_FREE_RUNNING_TIMER (the bits are paced by Timer0 compare match B on the timebase)"
+	#endif
+	#if USE_TELEMETRY && (ADC_AUTO_TRIGGER == ADC_TRIGGER_TIMER0)
+	#error "USE_TELEMETRY cannot be combined with ADC_TRIGGER_TIMER0 (both use OCR0B)"
+	#endif
+	#if USE_TELEMETRY && (TELEMETRY_PIN != PB2) && (TELEMETRY_PIN != PB4)
+	#error "TELEMETRY_PIN must be one of the spare pins PB2 or PB4"
+	#endif
+	#if USE_TELEMETRY && USE_INSTRUMENTATION && (TELEMETRY_PIN == INSTRUMENTATION_PIN)
+	#error "TELEMETRY_PIN and INSTRUMENTATION_PIN must be different pins"
+	#endif
+	#if (USE_BURST_FIRE == BURST_FIRE_BY_PIN) && (BURST_FIRE_PIN != PB2) && (BURST_FIRE_PIN != PB4)
+	#error "BURST_FIRE_PIN must be one of the spare pins PB2 or PB4"
+	#endif
+	#if (USE_BURST_FIRE == BURST_FIRE_BY_PIN) && ((USE_INSTRUMENTATION && (BURST_FIRE_PIN == INSTRUMENTATION_PIN)) || (USE_TELEMETRY && (BURST_FIRE_PIN == TELEMETRY_PIN)))
+	#error "BURST_FIRE_PIN is already used by USE_INSTRUMENTATION or USE_TELEMETRY"
+	#endif
+
+	#if USE_SPEED_CONTROL && (TACHO_PIN != PB2) && (TACHO_PIN != PB4)
+	#error "TACHO_PIN must be one of the spare pins PB2 or PB4"
+	#endif
+	#if USE_SPEED_CONTROL && ((USE_INSTRUMENTATION && (TACHO_PIN == INSTRUMENTATION_PIN)) || (USE_TELEMETRY && (TACHO_PIN == TELEMETRY_PIN)) || ((USE_BURST_FIRE == BURST_FIRE_BY_PIN) && (TACHO_PIN == BURST_FIRE_PIN)))
+	#error "TACHO_PIN is already used by USE_INSTRUMENTATION, USE_TELEMETRY or USE_BURST_FIRE"
+	#endif
+	#if USE_OVERCURRENT && (OVERCURRENT_CHANNEL != 1) && (OVERCURRENT_CHANNEL != 2)
+	#error "OVERCURRENT_CHANNEL must be 1 (ADC1, PB2) or 2 (ADC2, PB4)"
+	#endif
+	#if USE_OVERCURRENT
+	#define OVERCURRENT_PIN ((OVERCURRENT_CHANNEL == 1) ? PB2 : PB4)
+	#if (USE_INSTRUMENTATION && (INSTRUMENTATION_PIN == OVERCURRENT_PIN)) || (USE_TELEMETRY && (TELEMETRY_PIN == OVERCURRENT_PIN)) || ((USE_BURST_FIRE == BURST_FIRE_BY_PIN) && (BURST_FIRE_PIN == OVERCURRENT_PIN)) || (USE_SPEED_CONTROL && (TACHO_PIN == OVERCURRENT_PIN))
+	#error "The pin of OVERCURRENT_CHANNEL is already used by another option"
+	#endif
+	#endif
+
+	#ifndef F_CPU
+	#if HAL_ATMEGA8
+	#define F_CPU 8000000UL	// I/O clock frequency (internal oscillator 8 MHz)
+	#else
+	#define F_CPU 4800000UL	// I/O clock frequency (internal oscillator 4.8 MHz)
+	#endif
+	#endif
 
 	// Definitions for digital output (used for optocoupler / optotriac)
-	#define OPTOTRIAC_OFF PORTB   &= ~(1 << PB0)
-	#define OPTOTRIAC_ON PORTB    |= (1 << PB0)
-	#define OPTOTRIAK_TOGGLE PINB |= (1 << PINB0)
+	#define OPTOTRIAC_OFF PORTB   &= ~(1 << HAL_OPTOTRIAC_PIN)
+	#define OPTOTRIAC_ON PORTB    |= (1 << HAL_OPTOTRIAC_PIN)
+	#define OPTOTRIAK_TOGGLE PINB |= (1 << HAL_OPTOTRIAC_PIN)
+
+	// Instrumentation pin for a logic analyzer (USE_INSTRUMENTATION), each edge is a single sbi/cbi instruction (2 cycles)
+	#if USE_INSTRUMENTATION
+	#define INSTRUMENT_ISR_ENTER PORTB |= (1 << INSTRUMENTATION_PIN)
+	#define INSTRUMENT_ISR_EXIT PORTB  &= ~(1 << INSTRUMENTATION_PIN)
+	#define INSTRUMENT_TRIGGER do { INSTRUMENT_ISR_EXIT; INSTRUMENT_ISR_ENTER; } while (0)
+	#else
+	#define INSTRUMENT_ISR_ENTER do { } while (0)
+	#define INSTRUMENT_ISR_EXIT do { } while (0)
+	#define INSTRUMENT_TRIGGER do { } while (0)
+	#endif
+
+	// Output of the telemetry UART (USE_TELEMETRY), the line is high when idle
+	#define TELEMETRY_HIGH PORTB |= (1 << TELEMETRY_PIN)
+	#define TELEMETRY_LOW PORTB  &= ~(1 << TELEMETRY_PIN)
+
+	// Polarity of the half-period starting with the current INT0 edge (USE_BOTH_EDGES): zero-detect signal high = positive
+	#define ZERO_CROSS_POSITIVE (PINB & (1 << HAL_ZERO_CROSS_PIN))
+
+	// Selection of the burst-fire mode (USE_BURST_FIRE)
+	#if USE_BURST_FIRE == BURST_FIRE_BY_PIN
+	#define BURST_FIRE_SELECTED (!(PINB & (1 << BURST_FIRE_PIN)))
+	#else
+	#define BURST_FIRE_SELECTED 1
+	#endif
 
 	#define TIMER_STOP TCCR0B    &= ~((1 << CS00) | (1 << CS01) | (1 << CS02))
-	#define TIMER_INT_ON TIMSK0  |= (1 << OCIE0A)
-	#define TIMER_INT_OFF TIMSK0 &= ~(1 << OCIE0A)
+	#define TIMER_INT_ON HAL_TIMER_TIMSK  |= (1 << HAL_TIMER_OCIEA)
+	#define TIMER_INT_OFF HAL_TIMER_TIMSK &= ~(1 << HAL_TIMER_OCIEA)
+
+	// Compare output mode of OC0A (PB0) in register TCCR0A (used with USE_HW_OC0A; OC1A on PB1 on the ATmega8)
+	#define OC0A_SET_ON_MATCH   HAL_TIMER_TCCRA |= (1 << HAL_OCA_COM1) | (1 << HAL_OCA_COM0)
+	#define OC0A_CLEAR_ON_MATCH HAL_TIMER_TCCRA = (HAL_TIMER_TCCRA & ~(1 << HAL_OCA_COM0)) | (1 << HAL_OCA_COM1)
+	#define OC0A_FORCE_MATCH    HAL_OCA_FORCE_REG |= (1 << HAL_OCA_FORCE)
+
+	// Clock select bits (CS00, CS01, CS02) of register TCCR0B for the used prescalers
+	#define TIMER_CLOCK_PRESC_8   (1 << CS01)
+	#define TIMER_CLOCK_PRESC_64  ((1 << CS00) | (1 << CS01))
+	#define TIMER_CLOCK_PRESC_256 (1 << CS02)
+	#define TIMER_CLOCK_PRESC_1024 ((1 << CS00) | (1 << CS02))
 
 	// Definitions for CalculateADCValue() function
 	#define UPPER_THRESHOLD_VALUE 941	// 941 corresponds to 4.6 V
@@ -26,26 +352,352 @@
 	#define MAX_ADC_VALUE         1023	// Maximum value of a 10-bit ADC (at 5V)
 	#define MIN_ADC_VALUE         205	// Expected minimum voltage value with 100 kOhm potentiometer = 1 V
 	#define ADC_RANGE_VALUE (MAX_ADC_VALUE - MIN_ADC_VALUE)
+	// Fixed-point version (USE_FIXED_POINT): 100 / ADC_RANGE_VALUE ~ 31 / 256, the offset minimizes the error
+	#define ADC_PERCENT_FACTOR    31
+	#define ADC_PERCENT_OFFSET    108
+	#define ADC_PERCENT_SHIFT     8
+
+	// Defines for the oversampling in ADC_vect (ADC_OVERSAMPLING_SHIFT, ADC_AVERAGE_SHIFT)
+	#define ADC_OVERSAMPLING_COUNT (1 << ADC_OVERSAMPLING_SHIFT)
+	#define ADC_AVERAGE_COUNT      (1 << ADC_AVERAGE_SHIFT)
+	#define ADC_FILTER_SHIFT       (ADC_OVERSAMPLING_SHIFT + ADC_AVERAGE_SHIFT)
+	// Input channels of the ADC (MUX1:0 in register ADMUX): pot on ADC3, current sense on OVERCURRENT_CHANNEL (USE_OVERCURRENT)
+	#define ADC_MUX_MASK           ((1 << MUX1) | (1 << MUX0))
+	#define ADC_SELECT_POT         ADMUX = (ADMUX & ~ADC_MUX_MASK) | (1 << MUX1) | (1 << MUX0)
+	#define ADC_SELECT_CURRENT     ADMUX = (ADMUX & ~ADC_MUX_MASK) | OVERCURRENT_CHANNEL
+	// ADC clock F_CPU / 2^ADC_PRESCALER_LOG2, the fastest one within 50–200 kHz for full resolution
+	// (4.8 MHz / 32 = 150 kHz, one conversion takes 87 µs; 8 MHz / 64 = 125 kHz); ADPS2:0 are the bits 2:0 of ADCSRA on both parts
+	#define ADC_PRESCALER_LOG2     ((F_CPU <= 400000UL) ? 1 : (F_CPU <= 800000UL) ? 2 : (F_CPU <= 1600000UL) ? 3 : \
+		(F_CPU <= 3200000UL) ? 4 : (F_CPU <= 6400000UL) ? 5 : (F_CPU <= 12800000UL) ? 6 : 7)
+	#define ADC_PRESCALER_BITS     (ADC_PRESCALER_LOG2 << ADPS0)
+	// Half of that with USE_OVERCURRENT (the current is converted continuously, 4.8 MHz / 64 = 75 kHz, one conversion every 173 µs)
+	#define OVERCURRENT_PRESCALER_BITS (((ADC_PRESCALER_LOG2 < 7) ? ADC_PRESCALER_LOG2 + 1 : 7) << ADPS0)
+	#if F_CPU > 25600000UL
+	#error "F_CPU is too high for an ADC clock of at most 200 kHz"
+	#endif
 
 	// Defines for the SetWaitingPulse() function
-	#define ZERO_CROSS_DELAY_US             1000  // Time delay from the zero-detect pulse to the actual zero crossing (1000 µs)
-	#define ZERO_CROSS_DELAY_OCR0A_PRESC_64 74	  // Time delay from pulse for OCR0A with prescaler 64 (corresponds to 1000 µs)
-	#define TRIGGER_PULSE_DURATION_PRESC_8  149	  // Duration of the trigger pulse with prescaler 8 (250 µs)
-	#define HALF_PERIOD_DURATION_US         10000 // Duration of half the AC period (in µs) 
+	// Duration of half the AC period (in µs): 500000 / MAINS_FREQUENCY_HZ in 16-bit unsigned arithmetic (10000 at 50 Hz, 8333 at 60 Hz)
+	#define HALF_PERIOD_DURATION_US   ((50000U / MAINS_FREQUENCY_HZ) * 10 + (50000U % MAINS_FREQUENCY_HZ) * 10 / MAINS_FREQUENCY_HZ)
+	#define TRIGGER_PULSE_DURATION_US 250   // Duration of the trigger pulse (in µs)
+
+	// Timer0 ticks of a delay in µs at the given prescaler (floor of F_CPU * time / prescaler), OCR0A is one less
+	#define TIMER_TICKS(prescaler, time)       ((unsigned long)(time) * (F_CPU / 1000) / 1000 / (prescaler))
+	#define TIMER_OCR0A_VALUE(prescaler, time) (TIMER_TICKS(prescaler, time) - 1)
+	// Delays shorter than this take at most 254 ticks, i.e. fit 8-bit OCR0A (425 µs and 3400 µs for prescaler 8 and 64 at 4.8 MHz)
+	#define TIMER_PRESCALER_LIMIT_US(prescaler) (255UL * (prescaler) * 1000 / (F_CPU / 1000))
+	// Prescaler 1024 is only used when prescaler 256 cannot cover the half period (F_CPU above 6.5 MHz at 50 Hz)
+	#define TIMER_USE_PRESC_1024 (TIMER_PRESCALER_LIMIT_US(256) < HALF_PERIOD_DURATION_US)
+	#define TIMER_LONGEST_PRESCALER (TIMER_USE_PRESC_1024 ? 1024 : 256)
+	// Prescaler and OCR0A of the full-on delay (ZERO_CROSS_DELAY_US) and of the trigger pulse
+	#define ZERO_CROSS_DELAY_PRESCALER TIMING_PRESCALER(ZERO_CROSS_DELAY_US)
+	#define ZERO_CROSS_DELAY_OCR0A     TIMER_OCR0A_VALUE(ZERO_CROSS_DELAY_PRESCALER, ZERO_CROSS_DELAY_US)
+	#define TRIGGER_PULSE_PRESCALER    TIMING_PRESCALER(TRIGGER_PULSE_DURATION_US)
+	#define TRIGGER_PULSE_OCR0A        TIMER_OCR0A_VALUE(TRIGGER_PULSE_PRESCALER, TRIGGER_PULSE_DURATION_US)
+
+	// Defines for the CalculateRegisterValue() function with USE_FIXED_POINT: F_CPU / 8 per µs, rounded to 1/128 (0.6 ~ 77 / 128 at 4.8 MHz)
+	#define TIMER_TICKS_SHIFT  7
+	#define TIMER_TICKS_FACTOR ((F_CPU / 8 * (1UL << TIMER_TICKS_SHIFT) + 500000) / 1000000)
+
+	// Defines for the free-running timebase (USE_FREE_RUNNING_TIMER)
+	// Timer0 counts continuously with prescaler 8 (1 tick = 1.667 µs), the overflow interrupt extends it to 16 bits (109 ms);
+	// Timer1 of the ATmega8 has all 16 bits in hardware (1 tick = 1 µs at 8 MHz)
+	#define TIMEBASE_PRESCALER    8
+	#define TIMEBASE_CLOCK        HAL_TIMER_CLOCK_PRESC_8
+	#define US_TO_TICKS_UL(time)  ((unsigned long)(time) * (F_CPU / TIMEBASE_PRESCALER / 1000) / 1000)	// Not truncated, for the range checks
+	#define US_TO_TICKS(time)     ((unsigned)US_TO_TICKS_UL(time))
+	#define TIMEBASE_MIN_LEAD     8	  // Minimum distance of a new compare target from the current time (ticks)
+	#define TIMEBASE_WRAP         (1UL << HAL_TIMEBASE_BITS) // Period of the counter, the compare match repeats with every wrap
+	#define DELAY_OFF             0xFFFF // Delay value meaning "do not fire in this half-period" (0% power)
+	#define ZERO_CROSS_DELAY_TICKS       US_TO_TICKS(ZERO_CROSS_DELAY_US)
+	#define HALF_PERIOD_DURATION_TICKS   US_TO_TICKS(HALF_PERIOD_DURATION_US)
+	#define PERCENT_DURATION_TICKS       US_TO_TICKS(HALF_PERIOD_DURATION_US / 100)
+	#define TRIGGER_PULSE_DURATION_TICKS US_TO_TICKS(TRIGGER_PULSE_DURATION_US)
+
+	// Defines for the pulse train (USE_PULSE_TRAIN)
+	#define PULSE_TRAIN_PULSE_TICKS US_TO_TICKS(PULSE_TRAIN_PULSE_US)
+	#define PULSE_TRAIN_GAP_TICKS   US_TO_TICKS(PULSE_TRAIN_GAP_US)
+	#if USE_PULSE_TRAIN && ((PULSE_TRAIN_COUNT < 1) || (PULSE_TRAIN_COUNT > 255))
+	#error "PULSE_TRAIN_COUNT must be 1 to 255"
+	#endif
+
+	// Defines for the telemetry UART (USE_TELEMETRY)
+	// Bit time in 1/16 ticks (9600 Bd = 62.5 ticks), the fraction is accumulated over the byte
+	#define TELEMETRY_BIT_TICKS_Q4 ((unsigned)((F_CPU / TIMEBASE_PRESCALER * 16 + TELEMETRY_BAUD / 2) / TELEMETRY_BAUD))
+	#define TELEMETRY_BYTE_BITS    10	// Start bit, 8 data bits, stop bit
+	// Time from the start of a byte to the end of its stop bit, plus the lead of the first compare match
+	#define TELEMETRY_BYTE_TICKS   ((TELEMETRY_BIT_TICKS_Q4 * TELEMETRY_BYTE_BITS + 15) / 16 + TIMEBASE_MIN_LEAD)
+	#define TELEMETRY_SYNC         0xA5	// First byte of every frame
+	#if USE_TELEMETRY && (F_CPU / TIMEBASE_PRESCALER / TELEMETRY_BAUD >= TIMEBASE_WRAP - TIMEBASE_MIN_LEAD)
+	#error "TELEMETRY_BAUD is too low, one bit must be shorter than one wrap of TCNT0"
+	#endif
+
+	// Defines for the ADC auto-trigger (ADC_AUTO_TRIGGER), trigger source bits ADTS2:0 in register ADCSRB
+	#define ADC_TRIGGER_SOURCE_INT0   (1 << ADTS1)				  // 0 1 0 - External Interrupt Request 0
+	#define ADC_TRIGGER_SOURCE_TIMER0 ((1 << ADTS2) | (1 << ADTS0)) // 1 0 1 - Timer/Counter Compare Match B
+	#ifndef ADC_TRIGGER_PHASE_US
+	#define ADC_TRIGGER_PHASE_US      200	// Time from the zero-cross pulse to the conversion start with ADC_TRIGGER_TIMER0
+	#endif
+	#define ADC_TRIGGER_PHASE_TICKS   US_TO_TICKS(ADC_TRIGGER_PHASE_US)
+	#if (ADC_AUTO_TRIGGER == ADC_TRIGGER_TIMER0) && (ADC_TRIGGER_PHASE_US * (F_CPU / TIMEBASE_PRESCALER / 1000) / 1000 >= TIMEBASE_WRAP - TIMEBASE_MIN_LEAD)
+	#error "ADC_TRIGGER_PHASE_US must be shorter than one wrap of TCNT0"
+	#endif
+
+	// Units of the firing delay: timebase ticks with USE_FREE_RUNNING_TIMER, microseconds otherwise
+	#if USE_FREE_RUNNING_TIMER
+	#define DELAY_UNITS(time) US_TO_TICKS(time)
+	#else
+	#define DELAY_UNITS(time) (time)
+	#endif
+	#define MIN_WAITING_TIME_US 20	// Shortest delay for SetWaitingTime() (OCR0A must not be 0)
+
+	// Defines for the CalibrateZeroCross() function (USE_ZERO_CROSS_CALIBRATION)
+	// The zero-detect pulse is the low level of PB1 around the zero crossing, INT0 comes on its rising edge (end of the pulse),
+	// so the INT0 edge is half of the pulse width after the zero crossing
+	#define CALIBRATION_PULSE_SHIFT   3	// Average of 2^3 = 8 pulses
+	#define CALIBRATION_PULSE_COUNT   (1 << CALIBRATION_PULSE_SHIFT)
+	#define CALIBRATION_MIN_WIDTH_US  200	// Pulses outside of this range are not used
+	#define CALIBRATION_MAX_WIDTH_US  4000
+	#define CALIBRATION_TIMEOUT_US    30000	// No edge within this time = no mains, the nominal ZERO_CROSS_DELAY_US is kept
+
+	// Signed delay corrections of the two half-periods (USE_BOTH_EDGES) in DELAY_UNITS
+	#if USE_FREE_RUNNING_TIMER
+	#define DELAY_OFFSET_UNITS(time) ((int)((long)(time) * (long)(F_CPU / TIMEBASE_PRESCALER / 1000) / 1000))
+	#else
+	#define DELAY_OFFSET_UNITS(time) ((int)(time))
+	#endif
+	#define ZERO_CROSS_OFFSET_POSITIVE DELAY_OFFSET_UNITS(ZERO_CROSS_OFFSET_POSITIVE_US)
+	#define ZERO_CROSS_OFFSET_NEGATIVE DELAY_OFFSET_UNITS(ZERO_CROSS_OFFSET_NEGATIVE_US)
+
+	// Defines for the SoftStart() function (USE_SOFT_START)
+	#define SOFT_START_STEP      DELAY_UNITS(SOFT_START_STEP_US)
+	#define SOFT_START_MAX_DELAY DELAY_UNITS(HALF_PERIOD_DURATION_US - ZERO_CROSS_DELAY_US - HALF_PERIOD_DURATION_US / 100) // Delay of 1% power
+
+	// Defines for the ReadDipSwitch() function (USE_DIP_SWITCH)
+	#define DIP_SWITCH_POSITIONS 8	// 3 switches, DIP_SWITCH_TABLE must have 8 entries
+
+	// Defines for the SetpointMoved() function (USE_SETPOINT_CACHE)
+	#define SETPOINT_NONE 0xFFFF	// No ADC value accepted yet
+
+	// Defines for the CalculateDelayFromADC() function (USE_HIGH_RESOLUTION)
+	// Conduction time per one ADC step in Q16 format (half period / ADC range * 65536)
+	#define ADC_DELAY_SCALE (((unsigned long)DELAY_UNITS(HALF_PERIOD_DURATION_US) * 65536UL + ADC_RANGE_VALUE / 2) / ADC_RANGE_VALUE)
+
+	// Defines for the MeasurePeriod() function (USE_PERIOD_MEASUREMENT)
+	#define MAINS_MIN_FREQUENCY_HZ 45	// Zero-cross intervals outside of this range are ignored
+	#define MAINS_MAX_FREQUENCY_HZ 65
+	#define HALF_PERIOD_MIN_TICKS  US_TO_TICKS(500000UL / MAINS_MAX_FREQUENCY_HZ)
+	#define HALF_PERIOD_MAX_TICKS  US_TO_TICKS(500000UL / MAINS_MIN_FREQUENCY_HZ)
+	#if (MAINS_FREQUENCY_HZ < MAINS_MIN_FREQUENCY_HZ) || (MAINS_FREQUENCY_HZ > MAINS_MAX_FREQUENCY_HZ)
+	#error "MAINS_FREQUENCY_HZ must be within MAINS_MIN_FREQUENCY_HZ and MAINS_MAX_FREQUENCY_HZ (45–65 Hz)"
+	#endif
+	#if ZERO_CROSS_DELAY_US >= HALF_PERIOD_DURATION_US
+	#error "ZERO_CROSS_DELAY_US must be shorter than the half period"
+	#endif
+	// Moving average of 2^3 = 8 half periods. The 16-bit filter state holds the half period times 2^PERIOD_FILTER_SHIFT, so with
+	// a faster timebase (9.6 MHz, the ATmega8 at 8 MHz) the average is shortened until the longest half period still fits
+	#define PERIOD_FILTER_SHIFT    (((US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) << 3) < 65536) ? 3 : \
+		((US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) << 2) < 65536) ? 2 : 1)
+	// Defines for the ZeroCrossPll() function (USE_ZERO_CROSS_PLL)
+	#ifndef PLL_WINDOW_US
+	#define PLL_WINDOW_US    500	// Edges further than this from the predicted one are rejected
+	#endif
+	#define PLL_WINDOW_TICKS US_TO_TICKS(PLL_WINDOW_US)
+	#define PLL_PHASE_SHIFT  2	// 1/4 of the phase error corrects the phase
+	#define PLL_PERIOD_SHIFT 4	// 1/16 of the phase error corrects the period
+	#ifndef PLL_MAX_COAST
+	#define PLL_MAX_COAST    2	// Missed edges bridged on the predicted phase before the lock is lost
+	#endif
+
+	// Defines for the TrimOscillator() function (USE_OSCCAL_TRIM)
+	#define OSCCAL_REFERENCE_50HZ_TICKS US_TO_TICKS(500000UL / 50)	// Half period of the mains at the nominal clock
+	#define OSCCAL_REFERENCE_60HZ_TICKS US_TO_TICKS(500000UL / 60)
+	#define OSCCAL_CAPTURE_SHIFT  4	// Measured half period within 1/16 (6 %) of a reference selects that reference
+	#define OSCCAL_DEADBAND_SHIFT 7	// No trimming while the error is below 1/128 (0.8 %, more than half of one OSCCAL step)
+	#define OSCCAL_TRIM_INTERVAL  32	// Valid half periods between two OSCCAL steps (the period filter has to settle)
+	#define OSCCAL_TRIM_LIMIT     8	// Maximum deviation from the factory value of OSCCAL
+
+	// Defines for the fast startup (USE_FAST_STARTUP)
+	#define STARTUP_LOCK_COUNT       2	// Consecutive matching half periods before the first firing
+	#define STARTUP_LOCK_SHIFT       4	// A half period matches when it is within 1/16 of the filtered one
+	#define CALIBRATION_MAGIC        0x5A	// First byte of valid calibration data in EEPROM (change with the layout of calibration_data)
+	#define CALIBRATION_SAVE_HOLDOFF (60 * (F_CPU / TIMEBASE_PRESCALER) / 65536)	// Wraps of the 16-bit timebase in 60 s, the time between two EEPROM saves and before the first one
+	#define CALIBRATION_SAVE_MAX     4	// Saves per power-up, bounds the EEPROM writes of a trim that keeps moving
+	#define CALIBRATION_OSCCAL_HYSTERESIS 1	// OSCCAL steps from the saved value that are not worth a save (the trim toggles by one step)
+
+	// Defines for the StackUnused() function (USE_STACK_MONITOR)
+	#define STACK_CANARY 0xC5	// Fill byte of the unused SRAM (unlikely as a return address or saved register)
+
+	// Defines for the SpeedControl() and MeasureSpeed() functions (USE_SPEED_CONTROL)
+	#define TACHO_FULL_SPEED_TICKS US_TO_TICKS(TACHO_FULL_SPEED_PERIOD_US)
+	#define TACHO_MIN_PERIOD_TICKS (TACHO_FULL_SPEED_TICKS / 2)	// Shorter intervals are glitches (above 200% speed)
+	// No pulse for 60 ms = motor stopped. The main loop checks it once per half period, so the timeout plus the longest half period
+	// must stay within one wrap of the 16-bit timebase (109 ms at 4.8 MHz); with a faster clock the timeout is shortened to that
+	#define TACHO_TIMEOUT_LIMIT_TICKS (65535UL - US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ))
+	#define TACHO_TIMEOUT_TICKS    ((unsigned)((US_TO_TICKS_UL(60000) < TACHO_TIMEOUT_LIMIT_TICKS) ? US_TO_TICKS_UL(60000) : TACHO_TIMEOUT_LIMIT_TICKS))
+	#define TACHO_SPEED_SCALE      (100UL * TACHO_FULL_SPEED_TICKS)	// Speed in % = TACHO_SPEED_SCALE / period
+	#define SPEED_MAX_SPEED        255	// Measured speed is saturated at 255 %
+	#define SPEED_OUTPUT_MAX       (100 << 8)	// 100% power in the Q8 format of the controller
+	#if USE_SPEED_CONTROL && ((TACHO_FULL_SPEED_PERIOD_US < 100) || (TACHO_FULL_SPEED_PERIOD_US >= 60000))
+	#error "TACHO_FULL_SPEED_PERIOD_US is out of range (it must be shorter than the 60 ms stop timeout)"
+	#endif
+	#if USE_SPEED_CONTROL && ((SPEED_KP > 255) || (SPEED_KI > 255))
+	#error "SPEED_KP and SPEED_KI must not exceed 255 (the products must fit 16 bits)"
+	#endif
+
+	// Scale factors in Q19 format replacing the divisions by 100 and by ADC range. The products with the measured half period
+	// (at most HALF_PERIOD_MAX_TICKS) must stay below 2^32, so with a faster timebase the half period is shifted right by
+	// HALF_PERIOD_SCALE_SHIFT before the multiplication (0 at 4.8 MHz, 1 at 8 and 9.6 MHz, costing at most 1 tick)
+	#define PERCENT_SCALE_Q19      ((uint32_t)((524288UL + 50) / 100))
+	#define ADC_RANGE_SCALE_Q19    ((uint32_t)((524288UL + ADC_RANGE_VALUE / 2) / ADC_RANGE_VALUE))
+	#define HALF_PERIOD_SCALE_SHIFT ((US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) < 8192) ? 0 : \
+		(US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) < 16384) ? 1 : 2)
+
+	// Compile-time versions of the SetWaitingPulse() and CalculateRegisterValue() calculations (used for the lookup table)
+	// The conduction time (µs) is (HALF_PERIOD_DURATION_US / 100) * percent, or the equal-power value from power_table.h
+	#define TIMING_IS_FULL_ON(percent)   TIMING_IS_FULL_ON_US((HALF_PERIOD_DURATION_US / 100) * (percent))
+	#define TIMING_DELAY_US(percent)     TIMING_DELAY_FROM_CONDUCTION_US((HALF_PERIOD_DURATION_US / 100) * (percent))
+	#define TIMING_IS_FULL_ON_US(conduction)         ((conduction) + ZERO_CROSS_DELAY_US >= HALF_PERIOD_DURATION_US)
+	#define TIMING_DELAY_FROM_CONDUCTION_US(conduction) ((unsigned long)HALF_PERIOD_DURATION_US - ((conduction) + ZERO_CROSS_DELAY_US))
+	#define TIMING_EQUAL_POWER_US(conduction)        ((unsigned long)HALF_PERIOD_DURATION_US * (conduction) / EQUAL_POWER_SCALE)
+	#define TIMING_PRESCALER(time)       ((time) < TIMER_PRESCALER_LIMIT_US(8) ? 8 : ((time) < TIMER_PRESCALER_LIMIT_US(64) ? 64 : \
+		((TIMER_USE_PRESC_1024 && ((time) >= TIMER_PRESCALER_LIMIT_US(256))) ? 1024 : 256)))
+	#define TIMING_CLOCK(time)           (TIMING_PRESCALER(time) == 8 ? TIMER_CLOCK_PRESC_8 : (TIMING_PRESCALER(time) == 64 ? TIMER_CLOCK_PRESC_64 : \
+		(TIMING_PRESCALER(time) == 256 ? TIMER_CLOCK_PRESC_256 : TIMER_CLOCK_PRESC_1024)))
+	#define TIMING_OCR0A(time)           TIMER_OCR0A_VALUE(TIMING_PRESCALER(time), time)
+
+	// Range checks of the derived timing, so that retuning F_CPU, MAINS_FREQUENCY_HZ or ZERO_CROSS_DELAY_US is only a rebuild
+	#if USE_FREE_RUNNING_TIMER
+	_Static_assert(US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) < 32768, "The longest half period must be shorter than half of the 16-bit timebase (F_CPU too high)");
+	_Static_assert(TRIGGER_PULSE_DURATION_TICKS >= TIMEBASE_MIN_LEAD, "The trigger pulse must be at least TIMEBASE_MIN_LEAD ticks (F_CPU too low)");
+	#else
+	_Static_assert(TIMER_TICKS(TIMER_LONGEST_PRESCALER, HALF_PERIOD_DURATION_US) <= 255, "The longest delay must fit 8-bit OCR0A at the slowest prescaler");
+	_Static_assert(ZERO_CROSS_DELAY_OCR0A <= 255, "The full-on delay must fit 8-bit OCR0A");
+	_Static_assert(TRIGGER_PULSE_OCR0A <= 255, "The trigger pulse must fit 8-bit OCR0A");
+	_Static_assert(TIMER_TICKS(8, MIN_WAITING_TIME_US) >= 2, "MIN_WAITING_TIME_US must give OCR0A > 0 at prescaler 8 (F_CPU too low)");
+	_Static_assert(TIMER_PRESCALER_LIMIT_US(8) * TIMER_TICKS_FACTOR < 32768, "CalculateRegisterValue() products must fit 16 bits with USE_FIXED_POINT");
+	#endif
+	// Every US_TO_TICKS() constant must fit 16 bits; the host build has a 32-bit unsigned, so only these checks catch the truncation.
+	// The longest half period also covers ZERO_CROSS_DELAY_US, the half period itself and the OSCCAL references
+	_Static_assert(US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) < 65536, "The longest half period must fit 16 bits of ticks (F_CPU too high)");
+	_Static_assert(US_TO_TICKS_UL(TRIGGER_PULSE_DURATION_US) < 65536, "TRIGGER_PULSE_DURATION_US must fit 16 bits of ticks");
+	_Static_assert((US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) >> HALF_PERIOD_SCALE_SHIFT) * 100ULL * PERCENT_SCALE_Q19 < 4294967296ULL,
+		"The CalculateDelay() product must fit 32 bits");
+	_Static_assert((US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) >> HALF_PERIOD_SCALE_SHIFT) * (unsigned long long)ADC_RANGE_VALUE * ADC_RANGE_SCALE_Q19
+		< 4294967296ULL, "The CalculateDelayFromADC() product must fit 32 bits");
+	_Static_assert((US_TO_TICKS_UL(500000UL / MAINS_MIN_FREQUENCY_HZ) << PERIOD_FILTER_SHIFT) < 65536, "The filter state of MeasurePeriod() must fit 16 bits");
+	#if USE_PULSE_TRAIN
+	_Static_assert(US_TO_TICKS_UL(PULSE_TRAIN_PULSE_US) < 65536, "PULSE_TRAIN_PULSE_US must fit 16 bits of ticks");
+	_Static_assert(US_TO_TICKS_UL(PULSE_TRAIN_GAP_US) < 65536, "PULSE_TRAIN_GAP_US must fit 16 bits of ticks");
+	#endif
+	#if USE_ZERO_CROSS_PLL
+	_Static_assert(US_TO_TICKS_UL(PLL_WINDOW_US) < 65536, "PLL_WINDOW_US must fit 16 bits of ticks");
+	#endif
+	#if USE_SPEED_CONTROL
+	_Static_assert(US_TO_TICKS_UL(TACHO_FULL_SPEED_PERIOD_US) < 65536, "TACHO_FULL_SPEED_PERIOD_US must fit 16 bits of ticks");
+	_Static_assert(TACHO_TIMEOUT_TICKS > 2 * TACHO_FULL_SPEED_TICKS, "The tachometer timeout must be longer than the pulse period at 50% speed (F_CPU too high)");
+	#endif
+	#if USE_ZERO_CROSS_CALIBRATION
+	_Static_assert(US_TO_TICKS_UL(CALIBRATION_TIMEOUT_US) < 65536, "CALIBRATION_TIMEOUT_US must fit 16 bits of ticks (F_CPU too high)");
+	_Static_assert(US_TO_TICKS_UL(CALIBRATION_MAX_WIDTH_US) < 65536, "CALIBRATION_MAX_WIDTH_US must fit 16 bits of ticks");
+	#endif
 
 	// Initialization functions
 	void PinsInit(void);
+	void InstrumentationPinInit(void);
+	void TelemetryPinInit(void);
+	void BurstFirePinInit(void);
+	void TachoInputInit(void);
 	void ZeroDetectorInputInit(void);
 	void OptotriacOutputInit(void);
 	void ADCInit(void);
+	void DipSwitchInit(void);
 	void TimerInit (void);
 	
 	// Run-time funkce
 	void ADCStart(void);
 	void SetWaitingPulse (unsigned percent);
+	void SetWaitingTime (unsigned timeDelay);
+	void SetWaitingTimeCached(unsigned timeDelay);
+	unsigned CalculateDelayFromADC(unsigned ADCValue);
 	unsigned CalculateADCValue(unsigned ADCValue);
 	char CalculateRegisterValue(unsigned prescaler, unsigned time);
 	void SetTimer (unsigned prescaler, char OCValue);
+	void SetTimerClock (unsigned char clock, char OCValue);
+	void SetWaitingPulseFromTable (unsigned char percent);
+	unsigned char ReadDipSwitch(void);
+	void SetWaitingPulseFromDipSwitch(unsigned char position);
+	unsigned CalculateDelay(unsigned percent);
+	unsigned char SetpointMoved(unsigned ADCValue);
+	unsigned CalculateDelayCached(unsigned ADCValue);
+	unsigned SoftStart(unsigned delay);
+	unsigned char BurstFire(unsigned percent);
+	unsigned CompensateZeroCross(unsigned delay, unsigned char positive);
+	void CalibrateZeroCross(void);
+	void TrimOscillator(void);
+	unsigned char ZeroCrossPll(unsigned *zeroCross);
+	unsigned char ZeroCrossPllTimeout(unsigned *zeroCross);
+	unsigned char MeasureSpeed(unsigned period);
+	unsigned char SpeedControl(unsigned char target, unsigned char speed);
+	void LoadCalibration(void);
+	void SaveCalibration(void);
+	unsigned StackUnused(void);
+
+	// Free-running timebase (USE_FREE_RUNNING_TIMER), must be called with interrupts disabled
+	unsigned TimebaseNow(void);
+	void TimebaseSchedule(unsigned time);
+	unsigned TimebaseRemaining(void);
+	unsigned CalculateDelayFromTable(unsigned char percent);
+	unsigned CalculateDelayFromDipSwitch(unsigned char position);
+	void ScheduleFiring(unsigned zeroCross, unsigned delay);
+	void MeasurePeriod(unsigned zeroCross);
+
+	/// High byte of the free-running timebase, incremented by the Timer0 overflow interrupt (8-bit timer only)
+	extern volatile unsigned char TimebaseHigh;
+	/// Timebase value of the next compare event
+	extern unsigned TimebaseEvent;
+	/// Filtered mains half period in timebase ticks (USE_PERIOD_MEASUREMENT, USE_TELEMETRY)
+	extern unsigned HalfPeriodTicks;
+	/// Valid half periods measured since the last call of TrimOscillator() (USE_OSCCAL_TRIM)
+	extern unsigned char PeriodSampleCount;
+	/// Consecutive half periods matching the filtered one, saturated at STARTUP_LOCK_COUNT (USE_FAST_STARTUP)
+	extern unsigned char MainsLockCount;
+	/// Measured minus nominal offset of the INT0 edge from the zero crossing in DELAY_UNITS (USE_ZERO_CROSS_CALIBRATION)
+	extern int ZeroCrossCorrection;
+	/// Zero-cross pulses rejected by MeasurePeriod() (free-running 8-bit counters, USE_TELEMETRY)
+	extern unsigned char MissedZeroCrossCount;
+	extern unsigned char SpuriousZeroCrossCount;
+
+	typedef struct {
+		unsigned char clock;   // Clock select bits for TCCR0B (0 = timer stopped, i.e. always OFF)
+		unsigned char OCValue; // Value added to TCNT0 and written to OCR0A
+	}timer_setting;
+
+	void CalculateTimerSetting(unsigned timeDelay, timer_setting *setting);
+	void SetTimerSetting(const timer_setting *setting);
+
+	/// Telemetry frame (USE_TELEMETRY), sent byte by byte in this order, 16-bit values little-endian
+	typedef struct {
+		unsigned char sync;          // TELEMETRY_SYNC
+		unsigned halfPeriod;         // Filtered half period (timebase ticks)
+		unsigned ADCValue;           // Last ADC result (0–1023)
+		unsigned delay;              // Delay from the zero-cross pulse to the trigger pulse (ticks, DELAY_OFF = not fired)
+		unsigned char missed;        // MissedZeroCrossCount
+		unsigned char spurious;      // SpuriousZeroCrossCount
+	#if USE_STACK_MONITOR
+		unsigned stackUnused;        // StackUnused(), SRAM bytes never reached by the stack
+	#endif
+		unsigned char checksum;      // 8-bit sum of all bytes from halfPeriod to the one before it
+	}telemetry_frame;
+
+	/// Calibration kept in EEPROM (USE_FAST_STARTUP)
+	typedef struct {
+		unsigned char magic;         // CALIBRATION_MAGIC
+		unsigned char oscillator;    // Trimmed OSCCAL (USE_OSCCAL_TRIM)
+		int zeroCrossCorrection;     // ZeroCrossCorrection in DELAY_UNITS (USE_ZERO_CROSS_CALIBRATION)
+		unsigned char mains;         // Last mains frequency (50 or 60 Hz)
+		unsigned char checksum;      // 8-bit sum of all bytes from magic to mains
+	}calibration_data;
 
 	typedef enum {
 		WAITING_FOR_TRIGGER, // Indicates the state where the timer is running, waiting based on the ADC value
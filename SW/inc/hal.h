@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * Compile-time hardware abstraction of the timer, the zero-cross input, the optotriac output and the pot input.
+ *
+ * ATtiny13 (default): 8-bit Timer0, zero cross on INT0 (PB1), optotriac on PB0 (OC0A), pot on ADC3 (PB3).
+ * The free-running timebase is TCNT0 extended to 16 bits by the overflow interrupt.
+ *
+ * ATmega8 (-mmcu=atmega8): 16-bit Timer1 with a single prescaler, zero cross on the input capture ICP1 (PB0)
+ * timestamped by the hardware, optotriac on PB1 (OC1A), pot on ADC0 (PC0). Only the free-running timebase
+ * (USE_FREE_RUNNING_TIMER) is available, the prescaler switching of the ATtiny13 build is not needed.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+	#include <avr/io.h>
+
+	#if defined(__AVR_ATmega8__)
+	#define HAL_ATMEGA8 1
+	#else
+	#define HAL_ATMEGA8 0
+	#endif
+
+	#if HAL_ATMEGA8
+	// Timer1 (16-bit), normal mode, prescaler 8
+	#define HAL_TIMEBASE_BITS     16
+	#define HAL_TIMER_TCCRA       TCCR1A
+	#define HAL_TIMER_TCCRB       TCCR1B
+	#define HAL_TIMER_TCNT        TCNT1
+	#define HAL_TIMER_OCRA        OCR1A
+	#define HAL_TIMER_OCRB        OCR1B
+	#define HAL_TIMER_TIMSK       TIMSK
+	#define HAL_TIMER_TIFR        TIFR
+	#define HAL_TIMER_OCIEA       OCIE1A
+	#define HAL_TIMER_OCIEB       OCIE1B
+	#define HAL_TIMER_OCFA        OCF1A
+	#define HAL_TIMER_OCFB        OCF1B
+	#define HAL_TIMER_CLOCK_PRESC_8 (1 << CS11)
+	#define HAL_TIMER_COMPA_vect  TIMER1_COMPA_vect
+	#define HAL_TIMER_COMPB_vect  TIMER1_COMPB_vect
+	// Compare output OC1A (PB1), the force bit is in TCCR1A
+	#define HAL_OCA_COM0          COM1A0
+	#define HAL_OCA_COM1          COM1A1
+	#define HAL_OCA_FORCE_REG     TCCR1A
+	#define HAL_OCA_FORCE         FOC1A
+	#define HAL_OPTOTRIAC_PIN     PB1
+	// Zero cross on the input capture ICP1 (PB0): rising edge, noise canceler, the capture register is the timestamp
+	#define HAL_ZERO_CROSS_PIN    PB0
+	#define HAL_ZERO_CROSS_vect   TIMER1_CAPT_vect
+	#define HAL_ZERO_CROSS_TIME() ICR1
+	// Pot on ADC0 (PC0), AVcc as reference (no digital input disable register on the ATmega8)
+	#define HAL_ADC_POT_MUX       (1 << REFS0)
+	#define HAL_ADC_POT_DIDR_INIT do { } while (0)
+	// OSCCAL of the internal RC oscillator is 8-bit
+	#define HAL_OSCCAL_MAX        255
+	#else
+	// Timer0 (8-bit)
+	#define HAL_TIMEBASE_BITS     8
+	#define HAL_TIMER_TCCRA       TCCR0A
+	#define HAL_TIMER_TCCRB       TCCR0B
+	#define HAL_TIMER_TCNT        TCNT0
+	#define HAL_TIMER_OCRA        OCR0A
+	#define HAL_TIMER_OCRB        OCR0B
+	#define HAL_TIMER_TIMSK       TIMSK0
+	#define HAL_TIMER_TIFR        TIFR0
+	#define HAL_TIMER_OCIEA       OCIE0A
+	#define HAL_TIMER_OCIEB       OCIE0B
+	#define HAL_TIMER_OCFA        OCF0A
+	#define HAL_TIMER_OCFB        OCF0B
+	#define HAL_TIMER_CLOCK_PRESC_8 (1 << CS01)
+	#define HAL_TIMER_COMPA_vect  TIM0_COMPA_vect
+	#define HAL_TIMER_COMPB_vect  TIM0_COMPB_vect
+	// Compare output OC0A (PB0), the force bit is in TCCR0B
+	#define HAL_OCA_COM0          COM0A0
+	#define HAL_OCA_COM1          COM0A1
+	#define HAL_OCA_FORCE_REG     TCCR0B
+	#define HAL_OCA_FORCE         FOC0A
+	#define HAL_OPTOTRIAC_PIN     PB0
+	// Zero cross on INT0 (PB1), timestamped by the ISR
+	#define HAL_ZERO_CROSS_PIN    PB1
+	#define HAL_ZERO_CROSS_vect   INT0_vect
+	#define HAL_ZERO_CROSS_TIME() TimebaseNow()
+	// Pot on ADC3 (PB3), Vcc as reference
+	#define HAL_ADC_POT_MUX       ((1 << MUX0) | (1 << MUX1))
+	#define HAL_ADC_POT_DIDR_INIT DIDR0 |= (1 << ADC3D)
+	// OSCCAL is 7-bit (bit 7 is reserved)
+	#define HAL_OSCCAL_MAX        127
+	#endif
+
+	// Value written to a compare register of the timebase: the low byte with the 8-bit timer
+	#if HAL_TIMEBASE_BITS == 16
+	#define HAL_TIMER_COMPARE(time) (time)
+	#else
+	#define HAL_TIMER_COMPARE(time) ((unsigned char)(time))
+	#endif
+#endif /* HAL_H_ */
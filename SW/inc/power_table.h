@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Generated by tools/power_table.py, do not edit.
+ *
+ * Conduction time giving equal steps of the delivered power (resistive load) for every setpoint 1–100%,
+ * in 1/10000 of the half period: ENTRY(percent, conduction)
+ */
+
+#ifndef POWER_TABLE_H_
+#define POWER_TABLE_H_
+	#define EQUAL_POWER_SCALE 10000
+
+	#define EQUAL_POWER_TABLE(ENTRY) \
+		ENTRY(1, 1160) ENTRY(2, 1469) ENTRY(3, 1690) ENTRY(4, 1868) ENTRY(5, 2020) ENTRY(6, 2154) ENTRY(7, 2276) ENTRY(8, 2388) ENTRY(9, 2492) ENTRY(10, 2589) \
+		ENTRY(11, 2681) ENTRY(12, 2769) ENTRY(13, 2853) ENTRY(14, 2933) ENTRY(15, 3010) ENTRY(16, 3085) ENTRY(17, 3158) ENTRY(18, 3228) ENTRY(19, 3296) ENTRY(20, 3363) \
+		ENTRY(21, 3428) ENTRY(22, 3492) ENTRY(23, 3555) ENTRY(24, 3616) ENTRY(25, 3676) ENTRY(26, 3736) ENTRY(27, 3794) ENTRY(28, 3851) ENTRY(29, 3908) ENTRY(30, 3964) \
+		ENTRY(31, 4020) ENTRY(32, 4074) ENTRY(33, 4129) ENTRY(34, 4182) ENTRY(35, 4235) ENTRY(36, 4288) ENTRY(37, 4341) ENTRY(38, 4393) ENTRY(39, 4444) ENTRY(40, 4496) \
+		ENTRY(41, 4547) ENTRY(42, 4598) ENTRY(43, 4649) ENTRY(44, 4699) ENTRY(45, 4749) ENTRY(46, 4800) ENTRY(47, 4850) ENTRY(48, 4900) ENTRY(49, 4950) ENTRY(50, 5000) \
+		ENTRY(51, 5050) ENTRY(52, 5100) ENTRY(53, 5150) ENTRY(54, 5200) ENTRY(55, 5251) ENTRY(56, 5301) ENTRY(57, 5351) ENTRY(58, 5402) ENTRY(59, 5453) ENTRY(60, 5504) \
+		ENTRY(61, 5556) ENTRY(62, 5607) ENTRY(63, 5659) ENTRY(64, 5712) ENTRY(65, 5765) ENTRY(66, 5818) ENTRY(67, 5871) ENTRY(68, 5926) ENTRY(69, 5980) ENTRY(70, 6036) \
+		ENTRY(71, 6092) ENTRY(72, 6149) ENTRY(73, 6206) ENTRY(74, 6264) ENTRY(75, 6324) ENTRY(76, 6384) ENTRY(77, 6445) ENTRY(78, 6508) ENTRY(79, 6572) ENTRY(80, 6637) \
+		ENTRY(81, 6704) ENTRY(82, 6772) ENTRY(83, 6842) ENTRY(84, 6915) ENTRY(85, 6990) ENTRY(86, 7067) ENTRY(87, 7147) ENTRY(88, 7231) ENTRY(89, 7319) ENTRY(90, 7411) \
+		ENTRY(91, 7508) ENTRY(92, 7612) ENTRY(93, 7724) ENTRY(94, 7846) ENTRY(95, 7980) ENTRY(96, 8132) ENTRY(97, 8310) ENTRY(98, 8531) ENTRY(99, 8840) ENTRY(100, 10000)
+#endif /* POWER_TABLE_H_ */
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2025, Michal Chvatal
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD 3-Clause License found in the
+ * LICENSE file in the root directory of this source tree.
+ */ 
+
+/*
+ * Cycle-accurate ISR profiling of the firmware in the simavr ATtiny13 simulator.
+ *
+ * The firmware (Profile configuration, e.g. Profile/Regulator.elf) is executed instruction by instruction.
+ * A synthetic zero-cross pulse is applied to PB1 every half-period and the voltage on ADC3 (PB3)
+ * is ramped up and down between 1 V and 5 V. With USE_SPEED_CONTROL tachometer pulses are applied to TACHO_PIN.
+ * The clock, the mains frequency and the zero-cross delay are the ones of the firmware build: the profiler is
+ * compiled with the same CONFIG and the same defaults as functions.h. Reported are:
+ * - cycle counts of INT0_vect, PCINT0_vect, TIM0_OVF_vect, TIM0_COMPA_vect, TIM0_COMPB_vect and ADC_vect,
+ *   from the first instruction in the vector table to the end of RETI (the 4 cycles of the hardware interrupt
+ *   entry are not included),
+ * - the latency from the rising edge on PB1 to the rising edge on PB0 (trigger pulse),
+ * - the maximal stack depth, the lowest stack pointer sampled after every instruction (ISRs included).
+ *
+ * Usage: profile [firmware.elf] [half-periods] [-v]
+ *   -v prints one line per half-period: ADC voltage [mV], zero-cross to PB0 latency [cycles] and [µs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_adc.h>
+
+// Firmware configuration, same defaults as in functions.h (overridden by the same CONFIG)
+#ifndef F_CPU
+#define F_CPU               4800000UL
+#endif
+#ifndef MAINS_FREQUENCY_HZ
+#define MAINS_FREQUENCY_HZ  50
+#endif
+#ifndef ZERO_CROSS_DELAY_US
+#define ZERO_CROSS_DELAY_US 1000
+#endif
+#ifndef USE_SPEED_CONTROL
+#define USE_SPEED_CONTROL   0
+#endif
+// Pin names used in CONFIG (e.g. -DTACHO_PIN=PB4)
+#define PB2 2
+#define PB4 4
+#ifndef TACHO_PIN
+#define TACHO_PIN           PB2
+#endif
+
+#define HALF_PERIOD_CYCLES  ((avr_cycle_count_t)F_CPU / (2 * MAINS_FREQUENCY_HZ))
+#define ZERO_CROSS_PULSE_US (2 * ZERO_CROSS_DELAY_US)	// INT0 comes at the end of the pulse, which is symmetric around the zero crossing
+#define ADC_MIN_MV          1000	// Potentiometer range
+#define ADC_MAX_MV          5000
+#define ADC_STEP_MV         50		// Change of the ADC voltage per half-period
+#define TACHO_PERIOD_US     4000	// Tachometer pulses at 50% of TACHO_FULL_SPEED_PERIOD_US (2000 µs)
+#define TACHO_PULSE_US      100
+#define US_TO_CYCLES(time)  ((avr_cycle_count_t)(time) * F_CPU / 1000000UL)
+
+#define RETI_OPCODE 0x9518
+
+// Interrupt vectors of the ATtiny13 (word address = vector number, 1 word per vector)
+typedef struct {
+	const char *name;
+	unsigned vector;
+	unsigned long count;
+	avr_cycle_count_t total, min, max;
+} isr_profile;
+
+static isr_profile Profiles[] = {
+	{ "INT0_vect",       1, 0, 0, 0, 0 },
+	{ "PCINT0_vect",     2, 0, 0, 0, 0 },
+	{ "TIM0_OVF_vect",   3, 0, 0, 0, 0 },
+	{ "TIM0_COMPA_vect", 6, 0, 0, 0, 0 },
+	{ "TIM0_COMPB_vect", 7, 0, 0, 0, 0 },
+	{ "ADC_vect",        9, 0, 0, 0, 0 },
+};
+#define PROFILE_COUNT (sizeof(Profiles) / sizeof(Profiles[0]))
+
+static avr_irq_t *ZeroCrossIrq;
+#if USE_SPEED_CONTROL
+static avr_irq_t *TachoIrq;
+#endif
+static avr_irq_t *ADCIrq;
+static uint32_t ADCMillivolts = ADC_MIN_MV;
+static int ADCDirection = 1;
+static int Verbose = 0;
+
+// Zero-cross to trigger latency of the current half-period
+static avr_cycle_count_t ZeroCrossCycle;
+static int WaitingForTrigger = 0;
+static unsigned long LatencyCount = 0;
+static avr_cycle_count_t LatencyTotal = 0, LatencyMin = ~(avr_cycle_count_t)0, LatencyMax = 0;
+
+// Lowest stack pointer seen after any instruction (deepest stack use, including the ISRs)
+static uint16_t StackMin;
+
+/**
+ * @brief Rising edge of the zero-detect pulse (every half-period), also steps the ADC ramp.
+ */
+static avr_cycle_count_t ZeroCrossRising(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	(void)param;
+	if (WaitingForTrigger && Verbose)
+	{
+		printf("%5u      -     -\n", (unsigned)ADCMillivolts);
+	}
+	ADCMillivolts += ADCDirection * ADC_STEP_MV;
+	if (ADCMillivolts >= ADC_MAX_MV || ADCMillivolts <= ADC_MIN_MV)
+	{
+		ADCDirection = -ADCDirection;
+	}
+	if (ADCIrq)
+	{
+		avr_raise_irq(ADCIrq, ADCMillivolts);
+	}
+	ZeroCrossCycle = avr->cycle;
+	WaitingForTrigger = 1;
+	avr_raise_irq(ZeroCrossIrq, 1);
+	return when + HALF_PERIOD_CYCLES;
+}
+
+/**
+ * @brief Falling edge of the zero-detect pulse.
+ */
+static avr_cycle_count_t ZeroCrossFalling(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	(void)avr;
+	(void)param;
+	avr_raise_irq(ZeroCrossIrq, 0);
+	return when + HALF_PERIOD_CYCLES;
+}
+
+#if USE_SPEED_CONTROL
+/**
+ * @brief Tachometer pulse on TACHO_PIN (the firmware timestamps the rising edge).
+ */
+static avr_cycle_count_t TachoRising(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	(void)avr;
+	(void)param;
+	avr_raise_irq(TachoIrq, 1);
+	return when + US_TO_CYCLES(TACHO_PERIOD_US);
+}
+
+static avr_cycle_count_t TachoFalling(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	(void)avr;
+	(void)param;
+	avr_raise_irq(TachoIrq, 0);
+	return when + US_TO_CYCLES(TACHO_PERIOD_US);
+}
+#endif
+
+/**
+ * @brief PB0 (optotriac output) changed.
+ */
+static void TriggerChanged(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	avr_t *avr = (avr_t *)param;
+	if (value && !irq->value && WaitingForTrigger)
+	{
+		avr_cycle_count_t latency = avr->cycle - ZeroCrossCycle;
+		WaitingForTrigger = 0;
+		LatencyCount++;
+		LatencyTotal += latency;
+		if (latency < LatencyMin)
+		{
+			LatencyMin = latency;
+		}
+		if (latency > LatencyMax)
+		{
+			LatencyMax = latency;
+		}
+		if (Verbose)
+		{
+			printf("%5u %6llu %7.1f\n", (unsigned)ADCMillivolts, (unsigned long long)latency, latency * 1e6 / F_CPU);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = "../Profile/Regulator.elf";
+	unsigned long halfPeriods = 200;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-v") == 0)
+		{
+			Verbose = 1;
+		}
+		else if (strstr(argv[i], ".elf"))
+		{
+			file = argv[i];
+		}
+		else
+		{
+			halfPeriods = strtoul(argv[i], NULL, 10);
+		}
+	}
+
+	elf_firmware_t firmware;
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(file, &firmware) != 0)
+	{
+		fprintf(stderr, "Cannot read %s\n", file);
+		return 1;
+	}
+	avr_t *avr = avr_make_mcu_by_name("attiny13");
+	if (!avr)
+	{
+		fprintf(stderr, "simavr has no ATtiny13 core\n");
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);
+	avr->frequency = F_CPU;
+	avr->vcc = avr->avcc = avr->aref = 5000;
+
+	ZeroCrossIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1);
+	ADCIrq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC3);
+	if (!ADCIrq)
+	{
+		fprintf(stderr, "Warning: no ADC in the simulated core, ADC3 stays at 0 V\n");
+	}
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0), TriggerChanged, avr);
+	// The zero-detect pulse is the low level of PB1 around the zero crossing, INT0 comes on its rising edge (the end of the pulse)
+	avr_cycle_timer_register(avr, HALF_PERIOD_CYCLES, ZeroCrossRising, NULL);
+	avr_cycle_timer_register(avr, 2 * HALF_PERIOD_CYCLES - US_TO_CYCLES(ZERO_CROSS_PULSE_US), ZeroCrossFalling, NULL);
+#if USE_SPEED_CONTROL
+	TachoIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), TACHO_PIN);
+	avr_cycle_timer_register(avr, US_TO_CYCLES(TACHO_PERIOD_US), TachoRising, NULL);
+	avr_cycle_timer_register(avr, US_TO_CYCLES(TACHO_PERIOD_US + TACHO_PULSE_US), TachoFalling, NULL);
+#endif
+
+	if (Verbose)
+	{
+		printf("#   mV cycles      us\n");
+	}
+	StackMin = avr->ramend;
+	avr_cycle_count_t end = HALF_PERIOD_CYCLES * (halfPeriods + 1);
+	isr_profile *current = NULL;
+	avr_cycle_count_t entry = 0;
+	while (avr->cycle < end)
+	{
+		avr_flashaddr_t pc = avr->pc;
+		if (!current)
+		{
+			for (unsigned i = 0; i < PROFILE_COUNT; i++)
+			{
+				if (pc == Profiles[i].vector * 2)
+				{
+					current = &Profiles[i];
+					entry = avr->cycle;
+					break;
+				}
+			}
+		}
+		uint16_t opcode = avr->flash[pc] | (avr->flash[pc + 1] << 8);
+		int state = avr_run(avr);
+		if (state == cpu_Done || state == cpu_Crashed)
+		{
+			fprintf(stderr, "Simulation stopped (state %d)\n", state);
+			break;
+		}
+		uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+		if (sp < StackMin)
+		{
+			StackMin = sp;
+		}
+		if (current && opcode == RETI_OPCODE)
+		{
+			avr_cycle_count_t cycles = avr->cycle - entry;
+			if (current->count == 0 || cycles < current->min)
+			{
+				current->min = cycles;
+			}
+			if (cycles > current->max)
+			{
+				current->max = cycles;
+			}
+			current->total += cycles;
+			current->count++;
+			current = NULL;
+		}
+	}
+
+	printf("# %lu half-periods of %u Hz mains at %lu Hz\n", halfPeriods, (unsigned)MAINS_FREQUENCY_HZ, (unsigned long)F_CPU);
+	printf("# %-16s %6s %6s %8s %6s\n", "ISR", "count", "min", "average", "max");
+	for (unsigned i = 0; i < PROFILE_COUNT; i++)
+	{
+		isr_profile *p = &Profiles[i];
+		printf("  %-16s %6lu %6llu %8.1f %6llu\n", p->name, p->count, (unsigned long long)p->min,
+			p->count ? (double)p->total / p->count : 0.0, (unsigned long long)p->max);
+	}
+	if (LatencyCount)
+	{
+		printf("# zero cross to PB0 edge: %lu triggers, min %llu, average %.1f, max %llu cycles\n", LatencyCount,
+			(unsigned long long)LatencyMin, (double)LatencyTotal / LatencyCount, (unsigned long long)LatencyMax);
+	}
+	printf("# stack: max depth %u bytes (lowest SP 0x%04x, RAMEND 0x%04x)\n", (unsigned)(avr->ramend - StackMin),
+		(unsigned)StackMin, (unsigned)avr->ramend);
+	return 0;
+}
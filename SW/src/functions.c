@@ -6,24 +6,94 @@
  * LICENSE file in the root directory of this source tree.
  */ 
 
+#include <stddef.h>
 #include "functions.h"
 
+#if USE_FREE_RUNNING_TIMER
+#if HAL_TIMEBASE_BITS == 8
+volatile unsigned char TimebaseHigh = 0;
+#endif
+unsigned TimebaseEvent = 0;
+#endif
+#if USE_PERIOD_MEASUREMENT || USE_TELEMETRY
+unsigned HalfPeriodTicks = HALF_PERIOD_DURATION_TICKS;
+#endif
+#if USE_ZERO_CROSS_CALIBRATION
+int ZeroCrossCorrection = 0;
+#endif
+#if USE_OSCCAL_TRIM
+unsigned char PeriodSampleCount = 0;
+#endif
+#if USE_FAST_STARTUP
+unsigned char MainsLockCount = 0;
+#endif
+#if USE_TELEMETRY
+unsigned char MissedZeroCrossCount = 0;
+unsigned char SpuriousZeroCrossCount = 0;
+#endif
+
 /**
  * @brief Configure pin PB0 for optotriac output.
  * 
- * Sets pin 5 (PB0) as output and initializes the optotriac to OFF state.
+ * Sets pin 5 (PB0) as output and initializes the optotriac to OFF state (PB1 = OC1A on the ATmega8).
  */
 void OptotriacOutputInit(void)
 {
-	DDRB |= (1 << DDB0);
+	DDRB |= (1 << HAL_OPTOTRIAC_PIN);
 	OPTOTRIAC_OFF;
 }
 
+/**
+ * @brief Configure the instrumentation pin (USE_INSTRUMENTATION) as output, low.
+ */
+void InstrumentationPinInit(void)
+{
+#if USE_INSTRUMENTATION
+	DDRB |= (1 << INSTRUMENTATION_PIN);
+	INSTRUMENT_ISR_EXIT;
+#endif
+}
+
+/**
+ * @brief Configure the telemetry pin (USE_TELEMETRY) as output, high (idle level of the UART line).
+ */
+void TelemetryPinInit(void)
+{
+#if USE_TELEMETRY
+	TELEMETRY_HIGH;
+	DDRB |= (1 << TELEMETRY_PIN);
+#endif
+}
+
+/**
+ * @brief Configure the burst-fire selection pin (BURST_FIRE_BY_PIN) as input with pull-up.
+ */
+void BurstFirePinInit(void)
+{
+#if USE_BURST_FIRE == BURST_FIRE_BY_PIN
+	DDRB &= ~(1 << BURST_FIRE_PIN);
+	PORTB |= (1 << BURST_FIRE_PIN);
+#endif
+}
+
+/**
+ * @brief Configure the tachometer pin (USE_SPEED_CONTROL) as input with pull-up and enable its pin change interrupt.
+ */
+void TachoInputInit(void)
+{
+#if USE_SPEED_CONTROL
+	DDRB &= ~(1 << TACHO_PIN);
+	PORTB |= (1 << TACHO_PIN);
+	PCMSK |= (1 << TACHO_PIN);
+	GIMSK |= (1 << PCIE);
+#endif
+}
+
 /**
  * @brief Initialize ADC for potentiometer on pin PB3 (ADC3).
  * 
  * - Disables digital input buffer for power saving.  
- * - Configures ADC3 channel.  
+ * - Configures ADC3 channel (ADC0 with AVcc reference on the ATmega8).  
  * - Enables ADC and ADC interrupts.  
  */
 void ADCInit(void) 
@@ -31,13 +101,30 @@ void ADCInit(void)
 	// PIN PB3 is set as input after reset => DDR bit = 0 and pull-up resistor is disabled => PORT bit = 0
     // This is suitable, so leave it as is.
     // Disable digital input buffer on this pin (better for power consumption)
-	DIDR0 |= (1 << ADC3D);
+	HAL_ADC_POT_DIDR_INIT;
 	// Select pin ADC3 (PB3) => MUX0 = 1 and MUX1 = 1, select Vcc as reference => REFS0 = 0, left adjust result disabled => ADLAR = 0
-	ADMUX |= (1 << MUX0) | (1 << MUX1);
+	ADMUX |= HAL_ADC_POT_MUX;
 	// Enable ADC, enable auto-triggering, and enable interrupt for this peripheral
     // ADCSRA |= (1 << ADEN) | (1 << ADATE) | (1 << ADIE);
     // Enable ADC and enable interrupt for this peripheral
 	ADCSRA |= (1 << ADEN) | (1 << ADIE);
+#if ADC_AUTO_TRIGGER == ADC_TRIGGER_INT0
+	// Conversion is started by the hardware on the zero-cross edge (INTF0 flag), no CPU involvement
+	ADCSRB |= ADC_TRIGGER_SOURCE_INT0;
+	ADCSRA |= (1 << ADATE);
+#elif ADC_AUTO_TRIGGER == ADC_TRIGGER_TIMER0
+	// Conversion is started by the hardware on the compare match B (OCF0B flag), which INT0 sets ADC_TRIGGER_PHASE_US after the edge
+	ADCSRB |= ADC_TRIGGER_SOURCE_TIMER0;
+	ADCSRA |= (1 << ADATE);
+#endif
+#if USE_OVERCURRENT
+	// The current sense input is analog too, its conversions are chained between the pot samples
+	DIDR0 |= (OVERCURRENT_CHANNEL == 1) ? (1 << ADC1D) : (1 << ADC2D);
+	ADCSRA |= OVERCURRENT_PRESCALER_BITS;
+#elif ADC_FILTER_SHIFT
+	// Chained conversions are averaged, so run the ADC at the clock required for the full 10-bit accuracy
+	ADCSRA |= ADC_PRESCALER_BITS;
+#endif
 	// ADCSRB - mode selection (free running mode — We leave it because 0 0 0 means free running mode)
 			
 	// If free running mode is enabled, the first conversion cycle must be started by setting ADSC = 1, which performs initialization, then we don't do it anymore
@@ -46,15 +133,27 @@ void ADCInit(void)
 /**
  * @brief Configure pin for zero-cross detection of mains voltage.
  * 
- * Enables external interrupt on rising edge of PB1.
+ * Enables external interrupt on rising edge of PB1 (on any change with USE_BOTH_EDGES).
+ * On the ATmega8 the rising edge of PB0 (ICP1) is captured by Timer1 instead.
  */
 void ZeroDetectorInputInit(void)
 {
+#if HAL_ATMEGA8
+	// PIN PB0 (ICP1) is set as input after reset, suitable as it is
+	// Capture TCNT1 into ICR1 on the rising edge (ICES1 = 1) after 4 equal samples (ICNC1 = 1) and enable the capture interrupt
+	TCCR1B |= (1 << ICNC1) | (1 << ICES1);
+	TIMSK |= (1 << TICIE1);
+#else
     // PIN PB1 is set as input after reset => DDR bit = 0 and pull-up resistor is disabled => PORT bit = 0
     // This is suitable, so leave it as is.
     // Configure interrupt for pin PB1 (INT0) on rising edge and enable it:
+#if USE_BOTH_EDGES
+	MCUCR |= (1 << ISC00);				   // ISC00 = 1 and ISC01 = 0 - sets interrupt on any logical change
+#else
 	MCUCR |= (1 << ISC00) | (1 << ISC01);  // ISC00 = 1 and ISC01 = 1 - sets interrupt on rising edge
+#endif
 	GIMSK |= (1 << INT0);				   // INT0 = 1 - enables external interrupt on pin PB1
+#endif
 }
 
 /**
@@ -73,8 +172,17 @@ void ADCStart(void)
 void PinsInit(void)
 {
 	OptotriacOutputInit();
+	InstrumentationPinInit();
+	TelemetryPinInit();
+	BurstFirePinInit();
+	TachoInputInit();
 	ZeroDetectorInputInit();
+#if USE_DIP_SWITCH
+	// The setpoint is read from the port pins, the ADC stays off
+	DipSwitchInit();
+#else
 	ADCInit();
+#endif
 }
 
 void TimerInit(void)
@@ -102,9 +210,18 @@ void TimerInit(void)
      * With prescaler 64, the maximum measurable time is 3.4 ms
      * With prescaler 256, the maximum measurable time is 13.6 ms
 	 */
+#if USE_FREE_RUNNING_TIMER
+	// Free-running timebase: the timer is started once with prescaler 8 and never stopped,
+	// the overflow interrupt counts the wraps of TCNT0 (high byte of the timebase; Timer1 of the ATmega8 has 16 bits)
+	HAL_TIMER_TCCRB |= TIMEBASE_CLOCK;
+	#if HAL_TIMEBASE_BITS == 8
+	TIMSK0 |= (1 << TOIE0);
+	#endif
+#endif
 	return;
 }
 
+#if !USE_FREE_RUNNING_TIMER
 /**
  * @brief Configure Timer0 with given prescaler and OCR0A value.
  * 
@@ -113,27 +230,47 @@ void TimerInit(void)
  */
 void SetTimer(unsigned prescaler, char OCValue)
 {
-	// Disable interrupts of the running timer
-	TIMER_INT_OFF;
-	// Stop the running timer (reset the clock signal)
-	TIMER_STOP;
+	unsigned char clock = 0;
 	switch(prescaler){
 		case 8:
 			// Set the input clock (prescaler) to 8 (0 1 0) - this enables the timer function
             // With prescaler 8, the maximum measurable time is 425 µs
-			TCCR0B |= (1 << CS01);
+			clock = TIMER_CLOCK_PRESC_8;
 			break;
 		case 64:
 			// With prescaler 64, the maximum measurable time is 3.4 ms
             // Set the input clock (prescaler) to 64 (0 1 1) - this enables the timer function
-			TCCR0B |= (1 << CS00) | (1 << CS01);
+			clock = TIMER_CLOCK_PRESC_64;
 			break;
 		case 256:
 			// With prescaler 256, the maximum measurable time is 13.6 ms
             // Set the input clock (prescaler) to 256 (1 0 0) - this enables the timer function
-			TCCR0B |= (1 << CS02);
+			clock = TIMER_CLOCK_PRESC_256;
 			break;
+#if TIMER_USE_PRESC_1024
+		case 1024:
+			// Only with a clock too fast for prescaler 256 to cover the half period
+			clock = TIMER_CLOCK_PRESC_1024;
+			break;
+#endif
 	}
+	SetTimerClock(clock, OCValue);
+}
+
+/**
+ * @brief Configure Timer0 with given clock select bits and OCR0A value.
+ * 
+ * @param clock Clock select bits for TCCR0B (TIMER_CLOCK_PRESC_8, TIMER_CLOCK_PRESC_64, TIMER_CLOCK_PRESC_256).
+ * @param OCValue OCR0A register value.
+ */
+void SetTimerClock(unsigned char clock, char OCValue)
+{
+	// Disable interrupts of the running timer
+	TIMER_INT_OFF;
+	// Stop the running timer (reset the clock signal)
+	TIMER_STOP;
+	// Set the input clock (prescaler) - this enables the timer function
+	TCCR0B |= clock;
     // Clear interrupt flags
 	TIFR0 |= (1 << OCF0A);
 	// Set Output Compare Register (current timer value + desired value (e.g., 1ms) => 149)
@@ -159,7 +296,7 @@ void SetWaitingPulse(unsigned percent)
 	
 	if (percent == 100)
 	{
-		SetTimer(64, (char)ZERO_CROSS_DELAY_OCR0A_PRESC_64);
+		SetTimer(ZERO_CROSS_DELAY_PRESCALER, (char)ZERO_CROSS_DELAY_OCR0A);
 	}
 	else if(percent == 0)
 	{
@@ -172,21 +309,111 @@ void SetWaitingPulse(unsigned percent)
 	{
         // Calculate delay time in microseconds
 		// volatile unsigned timeDelay = HALF_PERIOD_DURATION_US - (((HALF_PERIOD_DURATION_US / 100) * percent) + ZERO_CROSS_DELAY_US);
-		volatile unsigned timeDelay = ((unsigned)HALF_PERIOD_DURATION_US - ((((unsigned)HALF_PERIOD_DURATION_US / 100) * percent) + (unsigned)ZERO_CROSS_DELAY_US));
-		if (timeDelay < 425)
+		unsigned conduction = (((unsigned)HALF_PERIOD_DURATION_US / 100) * percent) + (unsigned)ZERO_CROSS_DELAY_US;
+		if (conduction >= (unsigned)HALF_PERIOD_DURATION_US)
 		{
-			SetTimer(8, CalculateRegisterValue(8, timeDelay));
+			// Full conduction before 100% (shorter half period, e.g. 60 Hz), fired right at the zero crossing
+			SetTimer(ZERO_CROSS_DELAY_PRESCALER, (char)ZERO_CROSS_DELAY_OCR0A);
+			return;
 		}
-		else if(timeDelay < 3400)
+		unsigned timeDelay = (unsigned)HALF_PERIOD_DURATION_US - conduction;
+		SetWaitingTime(timeDelay);
+	}
+}
+
+/**
+ * @brief Start the timer for the given delay, selecting the finest prescaler that fits.
+ * 
+ * @param timeDelay Delay in microseconds (DELAY_OFF = timer stopped, always off).
+ */
+void SetWaitingTime(unsigned timeDelay)
+{
+	timer_setting setting;
+	CalculateTimerSetting(timeDelay, &setting);
+	SetTimerSetting(&setting);
+}
+
+/**
+ * @brief Select the finest prescaler that fits the delay and calculate the OCR0A value for it.
+ * 
+ * @param timeDelay Delay in microseconds (DELAY_OFF = timer stopped, always off).
+ * @param setting Calculated timer setting (clock 0 for DELAY_OFF).
+ */
+void CalculateTimerSetting(unsigned timeDelay, timer_setting *setting)
+{
+	if (timeDelay == DELAY_OFF)
+	{
+		setting->clock = 0;
+		setting->OCValue = 0;
+	}
+	else if (timeDelay < TIMER_PRESCALER_LIMIT_US(8))
+	{
+		// Shorter delays would give OCR0A = 0, i.e. a match only after a full wrap of the timer
+		if (timeDelay < MIN_WAITING_TIME_US)
 		{
-			SetTimer(64, CalculateRegisterValue(64, timeDelay));
-		}
-		else {
-			SetTimer(256, CalculateRegisterValue(256, timeDelay));
+			timeDelay = MIN_WAITING_TIME_US;
 		}
+		setting->clock = TIMER_CLOCK_PRESC_8;
+		setting->OCValue = (unsigned char)CalculateRegisterValue(8, timeDelay);
+	}
+	else if(timeDelay < TIMER_PRESCALER_LIMIT_US(64))
+	{
+		setting->clock = TIMER_CLOCK_PRESC_64;
+		setting->OCValue = (unsigned char)CalculateRegisterValue(64, timeDelay);
+	}
+#if TIMER_USE_PRESC_1024
+	else if(timeDelay >= TIMER_PRESCALER_LIMIT_US(256))
+	{
+		setting->clock = TIMER_CLOCK_PRESC_1024;
+		setting->OCValue = (unsigned char)CalculateRegisterValue(1024, timeDelay);
+	}
+#endif
+	else {
+		setting->clock = TIMER_CLOCK_PRESC_256;
+		setting->OCValue = (unsigned char)CalculateRegisterValue(256, timeDelay);
 	}
 }
 
+/**
+ * @brief Start the timer with a precalculated setting.
+ * 
+ * @param setting Timer setting from CalculateTimerSetting() (clock 0 = timer stopped, always off).
+ */
+void SetTimerSetting(const timer_setting *setting)
+{
+	if (setting->clock == 0)
+	{
+        // Disable interrupts of the running timer
+		TIMER_INT_OFF;
+        // Stop the running timer (reset the clock signal)
+		TIMER_STOP;
+	}
+	else
+	{
+		SetTimerClock(setting->clock, (char)setting->OCValue);
+	}
+}
+
+#if USE_SETPOINT_CACHE
+/**
+ * @brief Start the timer for the given delay, reusing the timer setting of the previous call when the delay is the same.
+ * 
+ * @param timeDelay Delay in microseconds (DELAY_OFF = timer stopped, always off).
+ */
+void SetWaitingTimeCached(unsigned timeDelay)
+{
+	static unsigned cachedDelay = DELAY_OFF;
+	static timer_setting setting = { 0, 0 };
+	if (timeDelay != cachedDelay)
+	{
+		cachedDelay = timeDelay;
+		CalculateTimerSetting(timeDelay, &setting);
+	}
+	SetTimerSetting(&setting);
+}
+#endif
+#endif
+
 /**
  * @brief Map ADC value to percentage (0–100%).
  * 
@@ -216,22 +443,1062 @@ unsigned CalculateADCValue(unsigned ADCValue)
 	else
 	{
 		// If value is between 10% and 90%, calculate the corresponding percentage
-		volatile unsigned long a = ((unsigned long)ADCValue - (unsigned long)MIN_ADC_VALUE) * 100 / ((unsigned long)ADC_RANGE_VALUE);
+#if USE_FIXED_POINT
+		// (ADCValue - MIN_ADC_VALUE) * 100 / ADC_RANGE_VALUE ~ ((ADCValue - MIN_ADC_VALUE) * 31 + 108) / 256
+		// 16-bit only (max. 736 * 31 + 108 = 22924), differs by at most +-1 % from the exact formula (in 149 of the 722 values)
+		return ((ADCValue - (unsigned)MIN_ADC_VALUE) * ADC_PERCENT_FACTOR + ADC_PERCENT_OFFSET) >> ADC_PERCENT_SHIFT;
+#else
+		unsigned long a = ((unsigned long)ADCValue - (unsigned long)MIN_ADC_VALUE) * 100 / ((unsigned long)ADC_RANGE_VALUE);
 		return((unsigned)a);
+#endif
 	}
 }
 
 
+#if USE_HIGH_RESOLUTION
+/**
+ * @brief Map ADC value directly to the firing delay (without the 0–100% stage).
+ * 
+ * The conduction time is proportional to the ADC value with a resolution of one ADC step
+ * (about 12 µs, i.e. 7 timebase ticks), instead of one percent (100 µs). The thresholds are the same as in CalculateADCValue().
+ * 
+ * @param ADCValue Raw 10-bit ADC value (0–1023).
+ * @return unsigned Delay from the zero-cross pulse in timebase ticks (microseconds without USE_FREE_RUNNING_TIMER), DELAY_OFF if always off.
+ */
+unsigned CalculateDelayFromADC(unsigned ADCValue)
+{
+	if (ADCValue > ((unsigned)UPPER_THRESHOLD_VALUE))
+	{
+		// Always ON - fire right at the zero crossing
+		return DELAY_UNITS(ZERO_CROSS_DELAY_US);
+	}
+	else if(ADCValue < ((unsigned)LOWER_THRESHOLD_VALUE))
+	{
+		// Always OFF
+		return DELAY_OFF;
+	}
+#if USE_PERIOD_MEASUREMENT
+	// Conduction time = (ADCValue - MIN_ADC_VALUE) * measured half period / ADC range, the division is replaced by a Q19 scale factor
+	unsigned halfPeriod = HalfPeriodTicks;
+	unsigned conduction = (unsigned)(((uint32_t)(ADCValue - MIN_ADC_VALUE) * (halfPeriod >> HALF_PERIOD_SCALE_SHIFT) * ADC_RANGE_SCALE_Q19)
+		>> (19 - HALF_PERIOD_SCALE_SHIFT));
+#else
+	// Conduction time = (ADCValue - MIN_ADC_VALUE) * half period / ADC range, the division is replaced by a Q16 scale factor
+	unsigned halfPeriod = DELAY_UNITS(HALF_PERIOD_DURATION_US);
+	unsigned conduction = (unsigned)(((unsigned long)(ADCValue - MIN_ADC_VALUE) * ADC_DELAY_SCALE) >> 16);
+#endif
+	if (conduction + DELAY_UNITS(ZERO_CROSS_DELAY_US) >= halfPeriod)
+	{
+		return DELAY_UNITS(ZERO_CROSS_DELAY_US);
+	}
+	return halfPeriod - DELAY_UNITS(ZERO_CROSS_DELAY_US) - conduction;
+}
+#endif
+
 /**
  * @brief Compute the value to be written into the OCR0A register   register value.
  * 
+ * With USE_FIXED_POINT the value is calculated as ((time >> shift) * 77) >> 7, where 77 / 128 ~ 4.8 / 8 and
+ * shift = 0, 3, 5 for prescaler 8, 64, 256. Products stay below 2^15 for the ranges used by SetWaitingTime().
+ * Compared to the exact formula the result differs by at most one timer tick:
+ * prescaler 8 (20–424 µs): 0 to +1 (103 of 405 values), prescaler 64 (425–3399 µs): -1 to +1 (611 of 2975),
+ * prescaler 256 (3400–9999 µs): -1 to +1 (1055 of 6600).
+ * 
  * @param prescaler Timer prescaler.
  * @param time Desired delay in microseconds.
  * @return char OCR0A value.
  */
  char CalculateRegisterValue(unsigned prescaler, unsigned time)
 {
+#if USE_FIXED_POINT
+	#if TIMER_USE_PRESC_1024
+	unsigned char shift = (prescaler == 8) ? 0 : ((prescaler == 64) ? 3 : ((prescaler == 256) ? 5 : 7));
+	#else
+	unsigned char shift = (prescaler == 8) ? 0 : ((prescaler == 64) ? 3 : 5);
+	#endif
+	return (char)((((time >> shift) * TIMER_TICKS_FACTOR) >> TIMER_TICKS_SHIFT) - 1);
+#else
 	// (ClockFrequency * DesiredTime) / (Prescaler * Conversion from µs to s) - 1;
-	volatile unsigned long a = (48 * (unsigned long)time / 10 / (unsigned long)prescaler) - 1;
+	unsigned long a = TIMER_OCR0A_VALUE(prescaler, time);
 	return ((char)a);
-}
\ No newline at end of file
+#endif
+}
+
+#if USE_SETPOINT_CACHE
+/// ADC value last accepted by SetpointMoved()
+static unsigned SetpointAccepted = SETPOINT_NONE;
+
+/**
+ * @brief Hysteresis on the ADC value: tell whether it has moved out of the deadband around the last accepted one.
+ * 
+ * @param ADCValue Raw 10-bit ADC value (0–1023).
+ * @return unsigned char 1 = more than ADC_DEADBAND away from the last accepted value (or the first call), ADCValue is accepted.
+ */
+unsigned char SetpointMoved(unsigned ADCValue)
+{
+	unsigned difference = (ADCValue > SetpointAccepted) ? ADCValue - SetpointAccepted : SetpointAccepted - ADCValue;
+	if ((SetpointAccepted != SETPOINT_NONE) && (difference <= ADC_DEADBAND))
+	{
+		return 0;
+	}
+	SetpointAccepted = ADCValue;
+	return 1;
+}
+
+/**
+ * @brief Firing delay of the ADC value, recalculated only when SetpointMoved() accepts a new value.
+ * 
+ * Linear mapping of CalculateDelay() (or CalculateDelayFromADC() with USE_HIGH_RESOLUTION) of the accepted value.
+ * With USE_PERIOD_MEASUREMENT the delay is also recalculated when the measured half period has changed.
+ * 
+ * @param ADCValue Raw 10-bit ADC value (0–1023).
+ * @return unsigned Delay in DELAY_UNITS (DELAY_OFF if always off).
+ */
+unsigned CalculateDelayCached(unsigned ADCValue)
+{
+	static unsigned cachedDelay = DELAY_OFF;
+#if USE_PERIOD_MEASUREMENT
+	static unsigned cachedHalfPeriod = 0;
+	if (!SetpointMoved(ADCValue) && (HalfPeriodTicks == cachedHalfPeriod))
+	{
+		return cachedDelay;
+	}
+	cachedHalfPeriod = HalfPeriodTicks;
+#else
+	if (!SetpointMoved(ADCValue))
+	{
+		return cachedDelay;
+	}
+#endif
+#if USE_HIGH_RESOLUTION
+	cachedDelay = CalculateDelayFromADC(SetpointAccepted);
+#else
+	cachedDelay = CalculateDelay(CalculateADCValue(SetpointAccepted));
+#endif
+	return cachedDelay;
+}
+#endif
+
+/**
+ * @brief Calculate the delay from the zero-cross pulse to the trigger pulse.
+ * 
+ * Same timing as SetWaitingPulse(), expressed in DELAY_UNITS (timebase ticks with USE_FREE_RUNNING_TIMER, µs otherwise).
+ * 
+ * @param percent Power level (0–100%).
+ * @return unsigned Delay in DELAY_UNITS (DELAY_OFF for 0%).
+ */
+unsigned CalculateDelay(unsigned percent)
+{
+	if (percent == 0)
+	{
+		return DELAY_OFF;
+	}
+#if USE_PERIOD_MEASUREMENT
+	// Conduction time = measured half period * percent / 100, the division is replaced by a Q19 scale factor
+	unsigned halfPeriod = HalfPeriodTicks;
+	unsigned conduction = (unsigned)(((uint32_t)(halfPeriod >> HALF_PERIOD_SCALE_SHIFT) * percent * PERCENT_SCALE_Q19)
+		>> (19 - HALF_PERIOD_SCALE_SHIFT));
+#else
+	unsigned halfPeriod = DELAY_UNITS(HALF_PERIOD_DURATION_US);
+	unsigned conduction = percent * DELAY_UNITS(HALF_PERIOD_DURATION_US / 100);
+#endif
+	if (conduction + DELAY_UNITS(ZERO_CROSS_DELAY_US) >= halfPeriod)
+	{
+		return DELAY_UNITS(ZERO_CROSS_DELAY_US);
+	}
+	return halfPeriod - DELAY_UNITS(ZERO_CROSS_DELAY_US) - conduction;
+}
+
+#if USE_SOFT_START
+/**
+ * @brief Limit the rate at which the firing delay may decrease (power increase).
+ * 
+ * Every call moves the delay at most SOFT_START_STEP closer to the requested one, starting from
+ * SOFT_START_MAX_DELAY after power-on and after every half-period without firing. A longer delay
+ * (less power) is applied immediately.
+ * 
+ * @param delay Requested delay in DELAY_UNITS (DELAY_OFF = do not fire).
+ * @return unsigned Delay for this half-period in DELAY_UNITS.
+ */
+unsigned SoftStart(unsigned delay)
+{
+	static unsigned rampDelay = DELAY_OFF;
+	if (delay >= rampDelay)
+	{
+		// Less power (or no change)
+		rampDelay = delay;
+		return delay;
+	}
+	if (rampDelay > SOFT_START_MAX_DELAY)
+	{
+		// Not fired in the last half-period, the first step lands on SOFT_START_MAX_DELAY
+		rampDelay = SOFT_START_MAX_DELAY + SOFT_START_STEP;
+	}
+	if (rampDelay - delay > SOFT_START_STEP)
+	{
+		rampDelay -= SOFT_START_STEP;
+	}
+	else
+	{
+		rampDelay = delay;
+	}
+	return rampDelay;
+}
+#endif
+
+#if USE_BURST_FIRE
+/**
+ * @brief Decide whether the current half-period is fired in the burst-fire mode.
+ * 
+ * Error diffusion (Bresenham) over whole mains cycles: the setpoint is added to the accumulator in the first
+ * half-period of every cycle and the cycle is fired whenever the accumulator reaches 100. Both half-periods
+ * of a cycle get the same decision, so the load current has no DC component.
+ * 
+ * @param percent Power level (0–100%).
+ * @return unsigned char 1 = fire right after the zero crossing, 0 = stay off.
+ */
+unsigned char BurstFire(unsigned percent)
+{
+	static unsigned char accumulator = 0;
+	static unsigned char secondHalf = 0;
+	static unsigned char fire = 0;
+	secondHalf ^= 1;
+	if (secondHalf)
+	{
+		accumulator += (unsigned char)percent;
+		fire = (accumulator >= 100);
+		if (fire)
+		{
+			accumulator -= 100;
+		}
+	}
+	return fire;
+}
+#endif
+
+#if USE_BOTH_EDGES || USE_ZERO_CROSS_CALIBRATION
+/**
+ * @brief Apply the offset compensation of the zero-detector to the delay of one half-period.
+ * 
+ * The detector switches at slightly different voltages on the rising and on the falling edge, so each
+ * polarity has its own correction (ZERO_CROSS_OFFSET_POSITIVE_US, ZERO_CROSS_OFFSET_NEGATIVE_US).
+ * With USE_ZERO_CROSS_CALIBRATION the delay is moved by the measured ZeroCrossCorrection.
+ * 
+ * @param delay Delay from the edge in DELAY_UNITS (DELAY_OFF = do not fire).
+ * @param positive Non-zero for the positive half-period (rising edge).
+ * @return unsigned Corrected delay in DELAY_UNITS (never below 0).
+ */
+unsigned CompensateZeroCross(unsigned delay, unsigned char positive)
+{
+	int offset = 0;
+#if USE_BOTH_EDGES
+	offset = positive ? ZERO_CROSS_OFFSET_POSITIVE : ZERO_CROSS_OFFSET_NEGATIVE;
+#endif
+#if USE_ZERO_CROSS_CALIBRATION
+	offset -= ZeroCrossCorrection;
+#endif
+	if (delay == DELAY_OFF)
+	{
+		return delay;
+	}
+	if ((offset < 0) && (delay < (unsigned)-offset))
+	{
+		// Fire as soon as possible (SetWaitingTime() and TimebaseSchedule() apply their minimum)
+		return 0;
+	}
+	return delay + offset;
+}
+#endif
+
+#if USE_ZERO_CROSS_CALIBRATION
+/// High byte of the time during the calibration (the overflow flag is polled, interrupts are not enabled yet)
+static unsigned char CalibrationHigh;
+
+/**
+ * @brief Read the 16-bit time of the calibration (Timer0 with prescaler 8 and TOV0 polled).
+ * 
+ * @return unsigned Time in ticks of 1/600 ms (at 4.8 MHz).
+ */
+static unsigned CalibrationNow(void)
+{
+	unsigned char low = TCNT0;
+	if (TIFR0 & (1 << TOV0))
+	{
+		TIFR0 = (1 << TOV0);
+		CalibrationHigh++;
+		// Read again, TCNT0 may have wrapped after the first read
+		low = TCNT0;
+	}
+	return ((unsigned)CalibrationHigh << 8) | low;
+}
+
+/**
+ * @brief Wait until PB1 has the given level.
+ * 
+ * The elapsed time is compared unsigned, so the timeout may be up to one wrap of the 16-bit time.
+ * 
+ * @param level Expected level (0 or 1).
+ * @param start Time of CalibrationNow() from which the timeout runs.
+ * @param timeout Ticks after start at which the waiting is given up.
+ * @return unsigned char 1 = level reached, 0 = timeout.
+ */
+static unsigned char CalibrationWaitFor(unsigned char level, unsigned start, unsigned timeout)
+{
+	while (((PINB >> PINB1) & 1) != level)
+	{
+		if ((unsigned)(CalibrationNow() - start) > timeout)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Measure the width of the zero-detect pulse and derive the offset of the INT0 edge from the zero crossing.
+ * 
+ * Called once at startup, before the interrupts are enabled and before TimerInit(). The pulse on PB1 is symmetric
+ * around the zero crossing, so the INT0 edge (end of the pulse) is half of its width after it. CALIBRATION_PULSE_COUNT
+ * pulses are averaged; when the mains is missing or a pulse width is out of range the nominal ZERO_CROSS_DELAY_US is kept.
+ * A pending INT0 flag from the measured edges is cleared.
+ */
+void CalibrateZeroCross(void)
+{
+	unsigned sum = 0;
+	unsigned char count = 0;
+	unsigned char attempts = 2 * CALIBRATION_PULSE_COUNT;
+
+	CalibrationHigh = 0;
+	TCNT0 = 0;
+	TIFR0 = (1 << TOV0);
+	TCCR0B = TIMER_CLOCK_PRESC_8;
+	while ((count < CALIBRATION_PULSE_COUNT) && attempts--)
+	{
+		// Falling edge = start of the pulse
+		unsigned begin = CalibrationNow();
+		if (!CalibrationWaitFor(1, begin, US_TO_TICKS(CALIBRATION_TIMEOUT_US)) || !CalibrationWaitFor(0, begin, US_TO_TICKS(CALIBRATION_TIMEOUT_US)))
+		{
+			break;
+		}
+		unsigned start = CalibrationNow();
+		if (!CalibrationWaitFor(1, start, US_TO_TICKS(CALIBRATION_MAX_WIDTH_US)))
+		{
+			continue;
+		}
+		unsigned width = CalibrationNow() - start;
+		if (width >= US_TO_TICKS(CALIBRATION_MIN_WIDTH_US))
+		{
+			sum += width;
+			count++;
+		}
+	}
+	TCCR0B = 0;
+	TCNT0 = 0;
+	TIFR0 = (1 << TOV0);
+	GIFR = (1 << INTF0);
+
+	if (count == CALIBRATION_PULSE_COUNT)
+	{
+		// Half of the average width in ticks, converted to DELAY_UNITS
+		unsigned offset = sum >> (CALIBRATION_PULSE_SHIFT + 1);
+	#if !USE_FREE_RUNNING_TIMER
+		offset = (unsigned)((unsigned long)offset * 1000 / (F_CPU / TIMEBASE_PRESCALER / 1000));
+	#endif
+		ZeroCrossCorrection = (int)offset - (int)DELAY_UNITS(ZERO_CROSS_DELAY_US);
+	}
+}
+#endif
+
+#if USE_LOOKUP_TABLE || USE_DIP_SWITCH
+#if USE_FREE_RUNNING_TIMER
+// One table entry for the conduction time in µs, the delay in timebase ticks calculated by the compiler exactly like CalculateDelay() does at run time
+#define TIMING_ENTRY_US(conduction) \
+	(TIMING_IS_FULL_ON_US(conduction) ? ZERO_CROSS_DELAY_TICKS : US_TO_TICKS(TIMING_DELAY_FROM_CONDUCTION_US(conduction)))
+#else
+// One table entry for the conduction time in µs, calculated by the compiler exactly like SetWaitingPulse() does at run time
+#define TIMING_ENTRY_US(conduction) { TIMING_ENTRY_CLOCK_US(conduction), TIMING_ENTRY_OCVALUE_US(conduction) }
+#define TIMING_ENTRY_CLOCK_US(conduction) \
+	(TIMING_IS_FULL_ON_US(conduction) ? TIMING_CLOCK(ZERO_CROSS_DELAY_US) : TIMING_CLOCK(TIMING_DELAY_FROM_CONDUCTION_US(conduction)))
+#define TIMING_ENTRY_OCVALUE_US(conduction) \
+	(TIMING_IS_FULL_ON_US(conduction) ? (unsigned char)ZERO_CROSS_DELAY_OCR0A : (unsigned char)TIMING_OCR0A(TIMING_DELAY_FROM_CONDUCTION_US(conduction)))
+#endif
+#define TIMING_ENTRY(percent) TIMING_ENTRY_US((HALF_PERIOD_DURATION_US / 100) * (percent))
+#define TIMING_ROW(tens) \
+	TIMING_ENTRY((tens) * 10 + 0), TIMING_ENTRY((tens) * 10 + 1), TIMING_ENTRY((tens) * 10 + 2), TIMING_ENTRY((tens) * 10 + 3), \
+	TIMING_ENTRY((tens) * 10 + 4), TIMING_ENTRY((tens) * 10 + 5), TIMING_ENTRY((tens) * 10 + 6), TIMING_ENTRY((tens) * 10 + 7), \
+	TIMING_ENTRY((tens) * 10 + 8), TIMING_ENTRY((tens) * 10 + 9)
+// One entry of EQUAL_POWER_TABLE (power_table.h)
+#define EQUAL_POWER_ENTRY(percent, conduction) TIMING_ENTRY_US(TIMING_EQUAL_POWER_US(conduction)),
+
+#if !USE_FREE_RUNNING_TIMER
+/**
+ * @brief Start the timer with a timer setting read from a flash table.
+ * 
+ * @param entry Table entry in flash (clock 0 = timer stopped, always off).
+ */
+static void SetTimerFromTable(const timer_setting *entry)
+{
+	unsigned char clock = pgm_read_byte(&entry->clock);
+	if (clock == 0)
+	{
+        // Disable interrupts of the running timer
+		TIMER_INT_OFF;
+        // Stop the running timer (reset the clock signal)
+		TIMER_STOP;
+	}
+	else
+	{
+		SetTimerClock(clock, (char)pgm_read_byte(&entry->OCValue));
+	}
+}
+#endif
+#endif
+
+#if USE_LOOKUP_TABLE
+#if USE_FREE_RUNNING_TIMER
+/// Delay from the zero-cross pulse for every 0–100% step (0% = always OFF, 100% = fire right at the zero crossing)
+static const unsigned DelayTable[101] PROGMEM = {
+	DELAY_OFF,
+#else
+/// Timer settings for every 0–100% step (0% = always OFF, 100% = fire right at the zero crossing)
+static const timer_setting TimerSettingsTable[101] PROGMEM = {
+	{ 0, 0 },
+#endif
+#if USE_EQUAL_POWER
+	EQUAL_POWER_TABLE(EQUAL_POWER_ENTRY)
+#else
+	TIMING_ENTRY(1), TIMING_ENTRY(2), TIMING_ENTRY(3), TIMING_ENTRY(4), TIMING_ENTRY(5),
+	TIMING_ENTRY(6), TIMING_ENTRY(7), TIMING_ENTRY(8), TIMING_ENTRY(9),
+	TIMING_ROW(1), TIMING_ROW(2), TIMING_ROW(3), TIMING_ROW(4), TIMING_ROW(5),
+	TIMING_ROW(6), TIMING_ROW(7), TIMING_ROW(8), TIMING_ROW(9),
+	TIMING_ENTRY(100)
+#endif
+};
+
+#if USE_FREE_RUNNING_TIMER
+/**
+ * @brief Read the firing delay for the given power level from the precomputed table.
+ * 
+ * Linear mapping as CalculateDelay(), or equal steps of the delivered power with USE_EQUAL_POWER.
+ * 
+ * @param percent Power level (0–100%).
+ * @return unsigned Delay in timebase ticks (DELAY_OFF for 0%).
+ */
+unsigned CalculateDelayFromTable(unsigned char percent)
+{
+	return pgm_read_word(&DelayTable[percent]);
+}
+#else
+/**
+ * @brief Configure delay and trigger pulse after zero-cross event using the precomputed table.
+ * 
+ * Same result as SetWaitingPulse(), but without any run-time arithmetic.
+ * With USE_EQUAL_POWER the table holds the equal-power firing angles instead.
+ * 
+ * @param percent Power level (0–100%). 0% = always off, 100% = always on.
+ */
+void SetWaitingPulseFromTable(unsigned char percent)
+{
+	SetTimerFromTable(&TimerSettingsTable[percent]);
+}
+#endif
+#endif
+
+#if USE_DIP_SWITCH
+// One entry of DIP_SWITCH_TABLE, 0% = always OFF
+#if USE_FREE_RUNNING_TIMER
+#define DIP_SWITCH_ENTRY(percent) ((percent) == 0 ? DELAY_OFF : TIMING_ENTRY(percent)),
+/// Delay from the zero-cross pulse for every position of the DIP switch
+static const unsigned DipSwitchDelayTable[] PROGMEM = {
+	DIP_SWITCH_TABLE(DIP_SWITCH_ENTRY)
+};
+// Unsized, a shorter DIP_SWITCH_TABLE would otherwise be zero-filled (delay 0 = full power)
+_Static_assert(sizeof(DipSwitchDelayTable) / sizeof(DipSwitchDelayTable[0]) == DIP_SWITCH_POSITIONS, "DIP_SWITCH_TABLE must have DIP_SWITCH_POSITIONS (8) entries");
+#else
+#define DIP_SWITCH_ENTRY(percent) { \
+	(percent) == 0 ? 0 : TIMING_ENTRY_CLOCK_US((HALF_PERIOD_DURATION_US / 100) * (percent)), \
+	(percent) == 0 ? 0 : TIMING_ENTRY_OCVALUE_US((HALF_PERIOD_DURATION_US / 100) * (percent)) },
+/// Timer settings for every position of the DIP switch
+static const timer_setting DipSwitchSettingsTable[] PROGMEM = {
+	DIP_SWITCH_TABLE(DIP_SWITCH_ENTRY)
+};
+// Unsized, a shorter DIP_SWITCH_TABLE would otherwise be zero-filled
+_Static_assert(sizeof(DipSwitchSettingsTable) / sizeof(DipSwitchSettingsTable[0]) == DIP_SWITCH_POSITIONS, "DIP_SWITCH_TABLE must have DIP_SWITCH_POSITIONS (8) entries");
+#endif
+
+/**
+ * @brief Read the position of the DIP switch (switch closed = pin pulled to GND = bit set).
+ * 
+ * @return unsigned char Position 0–7 (PB2 = bit 0, PB3 = bit 1, PB4 = bit 2).
+ */
+unsigned char ReadDipSwitch(void)
+{
+	return (unsigned char)(~PINB >> PINB2) & (DIP_SWITCH_POSITIONS - 1);
+}
+
+#if USE_FREE_RUNNING_TIMER
+/**
+ * @brief Read the firing delay for the given DIP switch position from the precomputed table.
+ * 
+ * @param position Position from ReadDipSwitch().
+ * @return unsigned Delay in timebase ticks (DELAY_OFF for 0%).
+ */
+unsigned CalculateDelayFromDipSwitch(unsigned char position)
+{
+	return pgm_read_word(&DipSwitchDelayTable[position]);
+}
+#else
+/**
+ * @brief Configure delay and trigger pulse after zero-cross event for the given DIP switch position.
+ * 
+ * @param position Position from ReadDipSwitch().
+ */
+void SetWaitingPulseFromDipSwitch(unsigned char position)
+{
+	SetTimerFromTable(&DipSwitchSettingsTable[position]);
+}
+#endif
+
+/**
+ * @brief Configure the DIP switch pins PB2–PB4 as inputs with pull-ups.
+ */
+void DipSwitchInit(void)
+{
+	DDRB &= ~((1 << DDB2) | (1 << DDB3) | (1 << DDB4));
+	PORTB |= (1 << PB2) | (1 << PB3) | (1 << PB4);
+}
+#endif
+
+#if USE_FREE_RUNNING_TIMER
+/**
+ * @brief Read the current value of the free-running timebase.
+ * 
+ * Must be called with interrupts disabled (i.e. from an ISR). An overflow that has already
+ * happened but has not been counted by the overflow ISR yet is taken into account.
+ * 
+ * @return unsigned 16-bit timebase value in ticks.
+ */
+unsigned TimebaseNow(void)
+{
+#if HAL_TIMEBASE_BITS == 16
+	// 16-bit counter, both bytes are read at once through the TEMP register of the timer
+	return HAL_TIMER_TCNT;
+#else
+	unsigned char high = TimebaseHigh;
+	unsigned char low = TCNT0;
+	// TOV0 is set and TCNT0 has already wrapped => the overflow ISR has not run yet
+	if ((TIFR0 & (1 << TOV0)) && (low < (TIMEBASE_WRAP / 2)))
+	{
+		high++;
+	}
+	return ((unsigned)high << 8) | low;
+#endif
+}
+
+/**
+ * @brief Set the next compare event of the free-running timebase.
+ * 
+ * Only the low byte of the target fits into OCR0A, so the compare match happens on every wrap
+ * of TCNT0. TIM0_COMPA_vect has to check TimebaseRemaining() and ignore the matches before the target.
+ * The 16-bit OCR1A of the ATmega8 takes the whole target.
+ * A target that is too close (or already in the past) is moved to TIMEBASE_MIN_LEAD ticks from now.
+ * 
+ * @param time Timebase value of the event in ticks.
+ */
+void TimebaseSchedule(unsigned time)
+{
+	unsigned now = TimebaseNow();
+	if ((int)(time - now) < TIMEBASE_MIN_LEAD)
+	{
+		time = now + TIMEBASE_MIN_LEAD;
+	}
+	TimebaseEvent = time;
+	HAL_TIMER_OCRA = HAL_TIMER_COMPARE(time);
+	// Clear only the compare flag (a read-modify-write would also clear a pending overflow)
+	HAL_TIMER_TIFR = (1 << HAL_TIMER_OCFA);
+	TIMER_INT_ON;
+}
+
+/**
+ * @brief Time remaining to the scheduled compare event.
+ * 
+ * @return unsigned Ticks to the event; zero or negative (as int) when the event is due.
+ */
+unsigned TimebaseRemaining(void)
+{
+	return TimebaseEvent - TimebaseNow();
+}
+
+#if USE_PERIOD_MEASUREMENT || USE_TELEMETRY
+/// Filter state of MeasurePeriod(): the half period multiplied by 2^PERIOD_FILTER_SHIFT
+/// (uint16_t like the timebase, the same as unsigned on the AVR, so the host simulation wraps the same way)
+static uint16_t PeriodFilter = HALF_PERIOD_DURATION_TICKS << PERIOD_FILTER_SHIFT;
+
+/**
+ * @brief Measure the mains half period from successive zero-cross pulses.
+ * 
+ * Intervals outside of the MAINS_MIN_FREQUENCY_HZ–MAINS_MAX_FREQUENCY_HZ window are ignored: a too short one
+ * (spurious pulse) keeps the previous reference, a too long one (missed pulse) only restarts the measurement.
+ * Valid intervals are filtered by an exponential moving average (1 / 2^PERIOD_FILTER_SHIFT).
+ * With USE_TELEMETRY the rejected pulses are counted (the first pulse after reset counts as missed).
+ * With USE_FAST_STARTUP an interval more than 1/2^STARTUP_LOCK_SHIFT away from the filtered value restarts
+ * the filter from that interval, MainsLockCount counts the consecutive matching ones.
+ * 
+ * @param zeroCross Timebase value captured at the zero-cross pulse.
+ */
+void MeasurePeriod(unsigned zeroCross)
+{
+	static uint16_t lastZeroCross = 0;
+	uint16_t interval = zeroCross - lastZeroCross;
+
+	if (interval < HALF_PERIOD_MIN_TICKS)
+	{
+		// Spurious pulse, keep measuring from the previous one
+	#if USE_TELEMETRY
+		SpuriousZeroCrossCount++;
+	#endif
+		return;
+	}
+	lastZeroCross = zeroCross;
+	if (interval > HALF_PERIOD_MAX_TICKS)
+	{
+		// Missed pulse (or the first one after reset)
+	#if USE_TELEMETRY
+		MissedZeroCrossCount++;
+	#endif
+	#if USE_FAST_STARTUP
+		MainsLockCount = 0;
+	#endif
+		return;
+	}
+#if USE_FAST_STARTUP
+	unsigned error = (interval > HalfPeriodTicks) ? interval - HalfPeriodTicks : HalfPeriodTicks - interval;
+	if (error > (HalfPeriodTicks >> STARTUP_LOCK_SHIFT))
+	{
+		// Not the period being tracked (startup, mains changed): start over from this interval
+		PeriodFilter = interval << PERIOD_FILTER_SHIFT;
+		MainsLockCount = 0;
+	}
+	else if (MainsLockCount < STARTUP_LOCK_COUNT)
+	{
+		MainsLockCount++;
+	}
+#endif
+	PeriodFilter += interval - (PeriodFilter >> PERIOD_FILTER_SHIFT);
+	HalfPeriodTicks = PeriodFilter >> PERIOD_FILTER_SHIFT;
+#if USE_OSCCAL_TRIM
+	PeriodSampleCount++;
+#endif
+}
+#endif
+
+#if USE_ZERO_CROSS_PLL
+/// Predicted time of the next zero-cross pulse and the tracked half period (ticks)
+static unsigned PllNext;
+static unsigned PllPeriod;
+/// Time of the last edge while not locked
+static unsigned PllLastEdge;
+/// Locked to the mains, number of edges bridged on the predicted phase
+static unsigned char PllLocked = 0;
+static unsigned char PllCoast = 0;
+
+/**
+ * @brief Software PLL tracking the mains phase from the zero-cross pulses.
+ * 
+ * While locked, an edge within PLL_WINDOW_TICKS of the predicted time corrects the phase by 1/2^PLL_PHASE_SHIFT
+ * and the period by 1/2^PLL_PERIOD_SHIFT of the error, other edges are rejected (spurious pulses, commutation spikes).
+ * The lock is acquired by two successive edges at a valid half-period interval; until then every edge is used as is.
+ * 
+ * @param zeroCross Timebase value captured at the edge, replaced by the filtered phase.
+ * @return unsigned char 1 = start the half-period at *zeroCross, 0 = ignore the edge.
+ */
+unsigned char ZeroCrossPll(unsigned *zeroCross)
+{
+	unsigned edge = *zeroCross;
+	if (PllLocked)
+	{
+		int error = (int)(edge - PllNext);
+		if ((error > (int)PLL_WINDOW_TICKS) || (error < -(int)PLL_WINDOW_TICKS))
+		{
+		#if USE_TELEMETRY
+			SpuriousZeroCrossCount++;
+		#endif
+			return 0;
+		}
+		PllPeriod += error >> PLL_PERIOD_SHIFT;
+		if ((PllPeriod < HALF_PERIOD_MIN_TICKS) || (PllPeriod > HALF_PERIOD_MAX_TICKS))
+		{
+			// Out of the mains frequency range, acquire again from this edge
+			PllLocked = 0;
+			PllLastEdge = edge;
+			return 1;
+		}
+		*zeroCross = PllNext + (error >> PLL_PHASE_SHIFT);
+		PllNext = *zeroCross + PllPeriod;
+		PllCoast = 0;
+		return 1;
+	}
+	unsigned interval = edge - PllLastEdge;
+	PllLastEdge = edge;
+	if ((interval >= HALF_PERIOD_MIN_TICKS) && (interval <= HALF_PERIOD_MAX_TICKS))
+	{
+		PllPeriod = interval;
+		PllNext = edge + interval;
+		PllCoast = 0;
+		PllLocked = 1;
+	}
+	return 1;
+}
+
+/**
+ * @brief Detect a missed zero-cross pulse (called from the Timer0 overflow interrupt).
+ * 
+ * When the window around the predicted edge has passed, the half-period is started on the predicted phase.
+ * After more than PLL_MAX_COAST missed edges in a row the lock is lost and nothing more is fired.
+ * 
+ * @param zeroCross Predicted time of the missed edge.
+ * @return unsigned char 1 = start the half-period at *zeroCross, 0 = nothing to do.
+ */
+unsigned char ZeroCrossPllTimeout(unsigned *zeroCross)
+{
+	if (!PllLocked || ((int)(TimebaseNow() - PllNext) <= (int)PLL_WINDOW_TICKS))
+	{
+		return 0;
+	}
+	if (++PllCoast > PLL_MAX_COAST)
+	{
+		PllLocked = 0;
+		return 0;
+	}
+#if USE_TELEMETRY
+	MissedZeroCrossCount++;
+#endif
+	*zeroCross = PllNext;
+	PllNext += PllPeriod;
+	return 1;
+}
+#endif
+
+#if USE_OSCCAL_TRIM
+/// Factory value of OSCCAL (read by LoadCalibration() or on the first call of TrimOscillator()), the trimming stays within OSCCAL_TRIM_LIMIT of it
+static int OscillatorFactory = -1;
+
+/**
+ * @brief Trim the internal RC oscillator against the mains frequency.
+ * 
+ * Called from the main loop with interrupts disabled. After every OSCCAL_TRIM_INTERVAL valid half periods
+ * the filtered half period is compared with the nearest nominal one (50 or 60 Hz). A longer measured period
+ * means the clock runs fast, so OSCCAL is decreased by one step (and the other way round). Nothing is changed
+ * inside the deadband, when the period is near neither reference or at OSCCAL_TRIM_LIMIT from the factory value.
+ */
+void TrimOscillator(void)
+{
+	if (OscillatorFactory < 0)
+	{
+		OscillatorFactory = OSCCAL;
+	}
+	if (PeriodSampleCount < OSCCAL_TRIM_INTERVAL)
+	{
+		return;
+	}
+	PeriodSampleCount = 0;
+
+	unsigned halfPeriod = HalfPeriodTicks;
+	unsigned reference = OSCCAL_REFERENCE_50HZ_TICKS;
+	if (halfPeriod < ((OSCCAL_REFERENCE_50HZ_TICKS + OSCCAL_REFERENCE_60HZ_TICKS) / 2))
+	{
+		reference = OSCCAL_REFERENCE_60HZ_TICKS;
+	}
+	unsigned error = (halfPeriod > reference) ? halfPeriod - reference : reference - halfPeriod;
+	if ((error < (reference >> OSCCAL_DEADBAND_SHIFT)) || (error > (reference >> OSCCAL_CAPTURE_SHIFT)))
+	{
+		return;
+	}
+	unsigned char calibration = OSCCAL;
+	int deviation = (int)calibration - OscillatorFactory;
+	if (halfPeriod > reference)
+	{
+		// Clock too fast
+		if ((deviation > -OSCCAL_TRIM_LIMIT) && (calibration > 0))
+		{
+			OSCCAL = calibration - 1;
+		}
+	}
+	else if ((deviation < OSCCAL_TRIM_LIMIT) && (calibration < HAL_OSCCAL_MAX))
+	{
+		// Clock too slow
+		OSCCAL = calibration + 1;
+	}
+}
+#endif
+
+#if USE_SPEED_CONTROL
+/**
+ * @brief Convert the period of the tachometer pulses to the speed.
+ * 
+ * @param period Interval of the last two pulses in timebase ticks (0 = motor stopped).
+ * @return unsigned char Speed in % of the speed given by TACHO_FULL_SPEED_PERIOD_US, saturated at SPEED_MAX_SPEED.
+ */
+unsigned char MeasureSpeed(unsigned period)
+{
+	if (period == 0)
+	{
+		return 0;
+	}
+	unsigned long speed = TACHO_SPEED_SCALE / period;
+	return (speed > SPEED_MAX_SPEED) ? SPEED_MAX_SPEED : (unsigned char)speed;
+}
+
+/**
+ * @brief PI speed controller, called from the main loop once per half-period.
+ * 
+ * Works in Q8 (1/256 %) with 16-bit arithmetic. Anti-windup: the integrator is clamped to the output range and it does not
+ * integrate further while the output is saturated in the direction of the error.
+ * 
+ * @param target Speed setpoint (0–100%), 0 switches the motor off and resets the integrator.
+ * @param speed Measured speed from MeasureSpeed().
+ * @return unsigned char Power level (0–100%) for CalculateDelay().
+ */
+unsigned char SpeedControl(unsigned char target, unsigned char speed)
+{
+	// Integrator in Q8, 0 to SPEED_OUTPUT_MAX
+	static int integral = 0;
+	if (target == 0)
+	{
+		integral = 0;
+		return 0;
+	}
+	int error = (int)target - (int)speed;
+	if (error < -100)
+	{
+		// Overspeed beyond 200% of the setpoint range, the products must stay within 16 bits
+		error = -100;
+	}
+	// Every sum is checked against the limits before it is formed, so nothing exceeds Q8 100%
+	int proportional = SPEED_KP * error;
+	int output;
+	if (proportional >= SPEED_OUTPUT_MAX - integral)
+	{
+		output = SPEED_OUTPUT_MAX;
+		if (error > 0)
+		{
+			error = 0;
+		}
+	}
+	else if (proportional <= -integral)
+	{
+		output = 0;
+		if (error < 0)
+		{
+			error = 0;
+		}
+	}
+	else
+	{
+		output = proportional + integral;
+	}
+	int step = SPEED_KI * error;
+	if (step >= SPEED_OUTPUT_MAX - integral)
+	{
+		integral = SPEED_OUTPUT_MAX;
+	}
+	else if (step <= -integral)
+	{
+		integral = 0;
+	}
+	else
+	{
+		integral += step;
+	}
+	// Rounded to whole percent
+	return (unsigned char)((unsigned)(output + 128) >> 8);
+}
+#endif
+
+#if USE_FAST_STARTUP
+/// Calibration data in EEPROM and the copy in SRAM of what has been (or is being) written there
+static calibration_data CalibrationEeprom EEMEM;
+static calibration_data Calibration;
+/// Index of the byte of Calibration to be written next (sizeof(Calibration) = nothing to write)
+static unsigned char CalibrationIndex = sizeof(Calibration);
+
+/**
+ * @brief 8-bit sum of the calibration data without the checksum byte.
+ */
+static unsigned char CalibrationChecksum(const calibration_data *data)
+{
+	unsigned char checksum = 0;
+	const unsigned char *byte = (const unsigned char *)data;
+	for (unsigned char i = 0; i < offsetof(calibration_data, checksum); i++)
+	{
+		checksum += byte[i];
+	}
+	return checksum;
+}
+
+/**
+ * @brief Restore the calibration saved in EEPROM.
+ * 
+ * Called once at startup, before CalibrateZeroCross() and TimerInit(). OSCCAL is only restored within
+ * OSCCAL_TRIM_LIMIT of the factory value, the zero-cross correction stays in effect when the measurement
+ * at startup fails, and the period filter starts from the last mains frequency, so two matching half periods
+ * are enough for the lock. Invalid data (erased EEPROM, other layout) is ignored and overwritten by the next save.
+ */
+void LoadCalibration(void)
+{
+#if USE_OSCCAL_TRIM
+	OscillatorFactory = OSCCAL;
+#endif
+	eeprom_read_block(&Calibration, &CalibrationEeprom, sizeof(Calibration));
+	if ((Calibration.magic != CALIBRATION_MAGIC) || (Calibration.checksum != CalibrationChecksum(&Calibration)))
+	{
+		Calibration.magic = 0;
+		return;
+	}
+#if USE_OSCCAL_TRIM
+	int deviation = (int)Calibration.oscillator - OscillatorFactory;
+	if ((deviation >= -OSCCAL_TRIM_LIMIT) && (deviation <= OSCCAL_TRIM_LIMIT))
+	{
+		OSCCAL = Calibration.oscillator;
+	}
+#endif
+#if USE_ZERO_CROSS_CALIBRATION
+	ZeroCrossCorrection = Calibration.zeroCrossCorrection;
+#endif
+	HalfPeriodTicks = (Calibration.mains == 60) ? OSCCAL_REFERENCE_60HZ_TICKS : OSCCAL_REFERENCE_50HZ_TICKS;
+	PeriodFilter = HalfPeriodTicks << PERIOD_FILTER_SHIFT;
+}
+
+/**
+ * @brief Save the calibration to EEPROM in the background.
+ * 
+ * Called from the main loop with interrupts disabled. While the mains is locked and CALIBRATION_SAVE_HOLDOFF
+ * has elapsed since power-up or since the last save, the current values are compared with the saved ones;
+ * when they differ, one byte is written per call once the previous write has finished (never waiting for
+ * the EEPROM), and unchanged bytes are not written at all. OSCCAL is only saved when it has moved more than
+ * CALIBRATION_OSCCAL_HYSTERESIS steps from the saved value, and there are at most CALIBRATION_SAVE_MAX saves
+ * per power-up, so a trim toggling between two steps does not wear out the EEPROM.
+ */
+void SaveCalibration(void)
+{
+	static unsigned holdoff = CALIBRATION_SAVE_HOLDOFF;
+	static unsigned char lastHigh = 0;
+	static unsigned char saves = CALIBRATION_SAVE_MAX;
+
+	if (CalibrationIndex < sizeof(Calibration))
+	{
+		if (eeprom_is_ready())
+		{
+			eeprom_update_byte((uint8_t *)&CalibrationEeprom + CalibrationIndex, ((unsigned char *)&Calibration)[CalibrationIndex]);
+			CalibrationIndex++;
+		}
+		return;
+	}
+	unsigned char high = (unsigned char)(TimebaseNow() >> 8);
+	if ((high < lastHigh) && holdoff)
+	{
+		holdoff--;
+	}
+	lastHigh = high;
+	if (holdoff || !saves || (MainsLockCount < STARTUP_LOCK_COUNT))
+	{
+		return;
+	}
+
+	calibration_data current = Calibration;
+	current.magic = CALIBRATION_MAGIC;
+#if USE_OSCCAL_TRIM
+	int step = (int)OSCCAL - Calibration.oscillator;
+	if ((Calibration.magic != CALIBRATION_MAGIC) || (step > CALIBRATION_OSCCAL_HYSTERESIS) || (step < -CALIBRATION_OSCCAL_HYSTERESIS))
+	{
+		current.oscillator = OSCCAL;
+	}
+#endif
+#if USE_ZERO_CROSS_CALIBRATION
+	current.zeroCrossCorrection = ZeroCrossCorrection;
+#endif
+	current.mains = (HalfPeriodTicks < ((OSCCAL_REFERENCE_50HZ_TICKS + OSCCAL_REFERENCE_60HZ_TICKS) / 2)) ? 60 : 50;
+	current.checksum = CalibrationChecksum(&current);
+	const unsigned char *saved = (const unsigned char *)&Calibration;
+	const unsigned char *byte = (const unsigned char *)&current;
+	for (unsigned char i = 0; i < sizeof(calibration_data); i++)
+	{
+		if (byte[i] != saved[i])
+		{
+			Calibration = current;
+			CalibrationIndex = 0;
+			holdoff = CALIBRATION_SAVE_HOLDOFF;
+			saves--;
+			return;
+		}
+	}
+}
+#endif
+
+#if USE_STACK_MONITOR && defined(__AVR__)
+// The host build (SW/host) has no AVR stack, it provides its own StackUnused()
+/// End of the static data (.data, .bss) defined by the linker, the stack grows down towards it
+extern unsigned char _end;
+
+/**
+ * @brief Fill the SRAM from the end of the static data up to RAMEND (__stack) with STACK_CANARY.
+ * 
+ * Placed into .init1, i.e. executed right after reset before the stack pointer is set and r1 is cleared,
+ * so it is naked and written in assembly (no stack, no zero register). .data and .bss are initialized afterwards.
+ */
+void StackPaint(void) __attribute__((naked, used, section(".init1")));
+void StackPaint(void)
+{
+	__asm__ volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M" (STACK_CANARY));
+}
+
+/**
+ * @brief Number of SRAM bytes between the static data and the stack that have never been written.
+ * 
+ * Counts the bytes still holding STACK_CANARY upwards from the end of .bss, so the deepest stack use
+ * since reset was RAMEND + 1 - &_end - StackUnused() bytes. Takes a few cycles per byte, call it with
+ * interrupts enabled.
+ * 
+ * @return unsigned Unused bytes (0 = the stack has reached the static data).
+ */
+unsigned StackUnused(void)
+{
+	const unsigned char *byte = &_end;
+	while ((byte <= (const unsigned char *)RAMEND) && (*byte == STACK_CANARY))
+	{
+		byte++;
+	}
+	return (unsigned)(byte - &_end);
+}
+#endif
+
+/**
+ * @brief Schedule the trigger pulse relative to the zero-cross pulse.
+ * 
+ * @param zeroCross Timebase value captured at the zero-cross pulse.
+ * @param delay Delay in timebase ticks (DELAY_OFF = do not fire).
+ */
+void ScheduleFiring(unsigned zeroCross, unsigned delay)
+{
+	if (delay == DELAY_OFF)
+	{
+		// Disable interrupts of the compare match, the timebase keeps running
+		TIMER_INT_OFF;
+	}
+	else
+	{
+		TimebaseSchedule(zeroCross + delay);
+	}
+}
+#endif
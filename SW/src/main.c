@@ -9,67 +9,639 @@
 // Includes
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "functions.h"
 	
-/// Global ADC result value
-volatile int ADCResult = 0;
+/**
+ * Global ADC result value (0–1023).
+ *
+ * Single producer (ADC_vect), lock-free handoff: ISRs do not nest, so INT0_vect always reads a complete value
+ * and needs no volatile access. Readers outside of interrupts use ReadADCResult(), which repeats the read
+ * when ADCSequence has changed in the meantime (the ADC interrupt came between the two bytes).
+ */
+unsigned ADCResult = 0;
+
+/// Incremented by ADC_vect after every write of ADCResult
+volatile unsigned char ADCSequence = 0;
+
+#if USE_LOOKUP_TABLE
+/// Power level (0–100%) calculated from ADCResult in the main loop
+volatile unsigned char SetpointPercent = 0;
+#endif
+
+#if USE_ADC_NOISE_REDUCTION
+/// Set by INT0, the main loop starts the conversion in ADC Noise Reduction mode once the timer is idle
+volatile unsigned char ADCRequest = 0;
+#endif
+
+#if USE_BURST_FIRE
+// Power level for the burst-fire mode, converted by the main loop (INT0 only adds and compares)
+#if USE_LOOKUP_TABLE
+#define BURST_FIRE_PERCENT SetpointPercent
+#else
+/// Power level (0–100%) of the burst-fire mode calculated from ADCResult in the main loop
+volatile unsigned char BurstFirePercent = 0;
+#define BURST_FIRE_PERCENT BurstFirePercent
+#endif
+#endif
+
+#if USE_SPEED_CONTROL
+/// Time of the last tachometer pulse and the interval of the last two (0 = motor stopped), written by PCINT0_vect
+static unsigned TachoLast;
+static unsigned TachoPeriod = 0;
+/// Cleared by the main loop when the motor has stopped, the next pulse then only starts the measurement
+static unsigned char TachoRunning = 0;
+/// Set by every half-period, the main loop then runs the speed controller once
+static volatile unsigned char SpeedControlRequest = 0;
+/// Power level (0–100%) from the speed controller, a single byte so that INT0 always reads a complete value
+static volatile unsigned char SpeedControlPercent = 0;
+#endif
+
+#if USE_OVERCURRENT
+/// Half-periods left without firing after the current sense has tripped
+static unsigned char OvercurrentBackoff = 0;
+/// The running conversion is on the current sense channel (otherwise on the pot)
+static unsigned char ADCSensingCurrent = 0;
+/// Set by every half-period, the next conversion is a pot sample
+static unsigned char ADCPotRequest = 0;
+#endif
 
 /// Current state of the controller
 volatile controller_states state = WAITING_FOR_TRIGGER;
 
+#if USE_PULSE_TRAIN
+/// Pulses of the train left in this half-period, including the current one
+static unsigned char PulseTrainRemaining;
+/// Last end of a pulse after which one more pulse still ends before the next zero crossing
+static unsigned PulseTrainDeadline;
+#endif
+
+#if USE_TELEMETRY
+/**
+ * Telemetry UART (transmit only, 8N1).
+ *
+ * The main loop starts a byte only when it ends, including the stop bit, before the next compare event
+ * of Timer0 and before the next expected zero-cross pulse, so TIM0_COMPB_vect never delays the trigger pulse.
+ * The bit edges are compare matches B on the timebase, relative to the start of the byte.
+ * The variables shared with the ISRs are only accessed with interrupts disabled.
+ */
+static telemetry_frame TelemetryFrame;
+/// Index of the byte of TelemetryFrame to be sent next (sizeof(TelemetryFrame) = frame completed)
+static unsigned char TelemetryIndex = sizeof(TelemetryFrame);
+/// Remaining bits of the byte being sent (LSB first), number of the next bit, time of the start bit
+static unsigned TelemetryShift;
+static unsigned char TelemetryBit;
+static unsigned TelemetryByteStart;
+/// Offset of the next bit edge from TelemetryByteStart in 1/16 ticks
+static unsigned TelemetryBitTime;
+/// Half-periods since the last frame was prepared
+static unsigned char TelemetryHalfPeriods = 0;
+/// Delay scheduled by the last INT0 and the expected time of the next zero-cross pulse
+static unsigned TelemetryDelay = DELAY_OFF;
+static unsigned TelemetryDeadline;
+#if USE_STACK_MONITOR
+/// Result of StackUnused() from the main loop, copied into the next frame
+static unsigned TelemetryStackUnused;
+#endif
+
+/**
+ * @brief Prepare the next telemetry frame and start the transmission of the next byte when there is time for it.
+ * 
+ * Must be called with interrupts disabled.
+ */
+static void TelemetryService(void)
+{
+	if (HAL_TIMER_TIMSK & (1 << HAL_TIMER_OCIEB))
+	{
+		// A byte is being sent
+		return;
+	}
+	if (TelemetryIndex >= sizeof(TelemetryFrame))
+	{
+		if (TelemetryHalfPeriods < TELEMETRY_INTERVAL)
+		{
+			return;
+		}
+		TelemetryHalfPeriods = 0;
+		TelemetryFrame.sync = TELEMETRY_SYNC;
+		TelemetryFrame.halfPeriod = HalfPeriodTicks;
+		TelemetryFrame.ADCValue = ADCResult;
+		TelemetryFrame.delay = TelemetryDelay;
+		TelemetryFrame.missed = MissedZeroCrossCount;
+		TelemetryFrame.spurious = SpuriousZeroCrossCount;
+	#if USE_STACK_MONITOR
+		TelemetryFrame.stackUnused = TelemetryStackUnused;
+	#endif
+		unsigned char checksum = 0;
+		unsigned char *byte = (unsigned char *)&TelemetryFrame;
+		for (unsigned char i = 1; i < sizeof(TelemetryFrame) - 1; i++)
+		{
+			checksum += byte[i];
+		}
+		TelemetryFrame.checksum = checksum;
+		TelemetryIndex = 0;
+	}
+	unsigned now = TimebaseNow();
+	unsigned end = now + TELEMETRY_BYTE_TICKS;
+	// The whole byte must fit before the next event of this half-period and before the next zero cross
+	if ((HAL_TIMER_TIMSK & (1 << HAL_TIMER_OCIEA)) && ((int)(TimebaseEvent - end) <= 0))
+	{
+		return;
+	}
+	if ((int)(TelemetryDeadline - end) <= 0)
+	{
+		return;
+	}
+	// Start bit (0), 8 data bits, stop bit (1)
+	TelemetryShift = (1 << 9) | ((unsigned)((unsigned char *)&TelemetryFrame)[TelemetryIndex] << 1);
+	TelemetryBit = 0;
+	TelemetryBitTime = 0;
+	TelemetryByteStart = now + TIMEBASE_MIN_LEAD;
+	HAL_TIMER_OCRB = HAL_TIMER_COMPARE(TelemetryByteStart);
+	HAL_TIMER_TIFR = (1 << HAL_TIMER_OCFB);
+	HAL_TIMER_TIMSK |= (1 << HAL_TIMER_OCIEB);
+}
+#endif
+
+#if USE_LOOKUP_TABLE || USE_BURST_FIRE
+/**
+ * @brief Read ADCResult outside of interrupts without tearing.
+ * 
+ * @return unsigned Last published ADC value (0–1023).
+ */
+static unsigned ReadADCResult(void)
+{
+	unsigned char sequence;
+	unsigned value;
+	do
+	{
+		sequence = ADCSequence;
+		value = *(volatile unsigned *)&ADCResult;
+	} while (sequence != ADCSequence);
+	return value;
+}
+#endif
+
 /**
  * @brief Main program loop.
  * 
  * Initializes peripherals, enables interrupts, and starts ADC.  
  * Then remains in an infinite loop (logic runs in ISRs).
+ * With USE_LOOKUP_TABLE (and with USE_BURST_FIRE) the loop converts the ADC value to percentage.
+ * With USE_OSCCAL_TRIM the loop trims the RC oscillator against the measured mains period.
+ * With USE_FAST_STARTUP the calibration is restored from EEPROM at startup and saved by the loop when it changes.
+ * With USE_SPEED_CONTROL the loop runs the PI speed controller once per half-period.
+ * With USE_TELEMETRY the loop prepares the telemetry frames and starts the transmission of every byte.
+ * With USE_SLEEP the CPU sleeps between interrupts (Idle mode keeps Timer0, ADC and INT0 running),
+ * so every interrupt is entered from the same state. With USE_ADC_NOISE_REDUCTION the conversion
+ * requested by INT0 is done in ADC Noise Reduction mode after the trigger pulse has ended
+ * (the I/O clock is stopped in this mode, so it can only be used while the timer is not needed
+ * and the INT0 edge is not expected).
  */
 int main(void)
 {
 	// Initialization functions
 	PinsInit();
+#if USE_FAST_STARTUP
+	// Stored OSCCAL first, everything timed afterwards runs on the trimmed clock
+	LoadCalibration();
+#endif
+#if USE_ZERO_CROSS_CALIBRATION
+	// Measure the zero-detect pulse before the timer is configured and the interrupts are enabled
+	CalibrateZeroCross();
+#endif
+	TimerInit();
 	// Enable interrupts
 	sei(); 
+#if !USE_DIP_SWITCH
 	// Initial start of ADC (also necessary when running in free running mode)
 	// (in free running mode ADC then starts automatically)
 	ADCStart();
+#endif
 	
     while (1) 
     {
+	#if USE_OSCCAL_TRIM
+		cli();
+		TrimOscillator();
+		sei();
+	#endif
+	#if USE_FAST_STARTUP
+		cli();
+		SaveCalibration();
+		sei();
+	#endif
+	#if USE_SPEED_CONTROL
+		cli();
+		if (SpeedControlRequest)
+		{
+			SpeedControlRequest = 0;
+			if ((TimebaseNow() - TachoLast) > TACHO_TIMEOUT_TICKS)
+			{
+				// No pulse for TACHO_TIMEOUT_TICKS (checked before the 16-bit timebase wraps)
+				TachoPeriod = 0;
+				TachoRunning = 0;
+			}
+			unsigned period = TachoPeriod;
+			unsigned value = ADCResult;
+			// Nothing is fired while held, the integrator is reset so that it does not wind up meanwhile
+			unsigned char hold = 0;
+		#if USE_OVERCURRENT
+			hold |= OvercurrentBackoff;
+		#endif
+		#if USE_FAST_STARTUP
+			hold |= (MainsLockCount < STARTUP_LOCK_COUNT);
+		#endif
+			sei();
+			// The controller runs with interrupts enabled, INT0 keeps using the previous power level meanwhile
+			SpeedControlPercent = SpeedControl(hold ? 0 : (unsigned char)CalculateADCValue(value), MeasureSpeed(period));
+		}
+		sei();
+	#endif
+	#if USE_TELEMETRY
+		#if USE_STACK_MONITOR
+		// The SRAM scan runs with interrupts enabled, the next frame takes the last result
+		TelemetryStackUnused = StackUnused();
+		#endif
+		cli();
+		TelemetryService();
+		sei();
+	#endif
+	#if USE_LOOKUP_TABLE
+		// Convert the ADC value here (outside of the interrupts), INT0 then only reads the table
+		#if USE_SETPOINT_CACHE
+		// Only a move out of the deadband changes the setpoint (no flicker from ±1 LSB noise)
+		unsigned value = ReadADCResult();
+		if (SetpointMoved(value))
+		{
+			SetpointPercent = (unsigned char)CalculateADCValue(value);
+		}
+		#else
+		SetpointPercent = (unsigned char)CalculateADCValue(ReadADCResult());
+		#endif
+	#elif USE_BURST_FIRE
+		// The same for the burst-fire accumulator of INT0
+		BurstFirePercent = (unsigned char)CalculateADCValue(ReadADCResult());
+	#endif
+	#if USE_SLEEP
+		cli();
+		#if USE_ADC_NOISE_REDUCTION
+		if (ADCRequest && !(TIMSK0 & (1 << OCIE0A)))
+		{
+			// Timer is idle => entering ADC Noise Reduction mode starts the conversion, the ADC interrupt wakes the CPU
+			ADCRequest = 0;
+			set_sleep_mode(SLEEP_MODE_ADC);
+		}
+		else
+		{
+			set_sleep_mode(SLEEP_MODE_IDLE);
+		}
+		#else
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		#endif
+		// The instruction after sei() is always executed, so no interrupt can be lost between sei() and sleep
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	#endif
 	}
 }
 
 /**
- * @brief ISR for zero-cross detection (INT0).
+ * @brief Start of a half-period, called from the zero-cross interrupt.
  * 
- * Interrupt service routine executed on the rising edge of pin PB1 (i.e., at zero crossing of the mains voltage)
+ * With USE_BOTH_EDGES the delay is corrected separately for the positive and the negative half-period.
  *
  * - Turns OFF triac.  
  * - Sets timer based on ADC value.  
  * - Starts next ADC conversion.  
+ *
+ * With USE_HW_OC0A the OC0A output is forced low and then set to go high by hardware on the compare match.
+ * With USE_FREE_RUNNING_TIMER the firing instant is scheduled relative to the timebase value captured on entry.
+ * With USE_SOFT_START the delay is passed through SoftStart(), which limits the power increase per half-period.
+ * With USE_DIP_SWITCH the power level is read from the DIP switch pins and no ADC conversion is started.
+ * With USE_SPEED_CONTROL the power level comes from the speed controller of the main loop instead of the ADC value.
+ * With USE_FAST_STARTUP nothing is fired until MeasurePeriod() has locked onto the mains period; the soft start
+ * ramp restarts after the lock.
+ * With USE_OVERCURRENT nothing is fired during the backoff after a trip; the soft start ramp restarts after it.
+ * In the burst-fire mode (USE_BURST_FIRE) only the accumulator of BurstFire() decides whether this cycle is fired.
+ *
+ * @param zeroCross Timebase value of the zero-cross pulse (USE_FREE_RUNNING_TIMER, unused otherwise).
  */
-ISR (INT0_vect) 
+static void StartHalfPeriod(unsigned zeroCross)
 {
+#if USE_BOTH_EDGES
+	// The level after the edge tells which half-period starts now
+	unsigned char positive = ZERO_CROSS_POSITIVE;
+#elif USE_ZERO_CROSS_CALIBRATION
+	// The detector gives a pulse around every zero crossing (no polarity level as with USE_BOTH_EDGES) and the pulse
+	// is symmetric, so the measured correction is the same for both half-periods; the polarity is not used
+	const unsigned char positive = 1;
+#endif
+#if USE_PERIOD_MEASUREMENT || USE_TELEMETRY
+	MeasurePeriod(zeroCross);
+#endif
+#if USE_HW_OC0A
+	// Force the OC0A pin low (a forced compare match with "clear" mode does not generate an interrupt)
+	OC0A_CLEAR_ON_MATCH;
+	OC0A_FORCE_MATCH;
+#else
 	OPTOTRIAC_OFF;
+#endif
 	// Start the timer (based on the ADC setting), then output a 250 µs trigger pulse on pin PB1
-	SetWaitingPulse(CalculateADCValue((unsigned)ADCResult));
+#if USE_FREE_RUNNING_TIMER
+	unsigned delay;
+	#if USE_OVERCURRENT
+	if (OvercurrentBackoff)
+	{
+		// Backoff after an overcurrent trip
+		OvercurrentBackoff--;
+		delay = DELAY_OFF;
+		#if USE_SOFT_START
+		// Restart the ramp, the first firing after the backoff is at SOFT_START_MAX_DELAY
+		SoftStart(DELAY_OFF);
+		#endif
+	}
+	else
+	#endif
+	#if USE_FAST_STARTUP
+	if (MainsLockCount < STARTUP_LOCK_COUNT)
+	{
+		// The mains period is not locked yet (power-up, mains dropout)
+		delay = DELAY_OFF;
+		#if USE_SOFT_START
+		// Restart the ramp, the output comes back from SOFT_START_MAX_DELAY after the relock
+		SoftStart(DELAY_OFF);
+		#endif
+	}
+	else
+	#endif
+	#if USE_BURST_FIRE
+	if (BURST_FIRE_SELECTED)
+	{
+		// Whole cycles, fired right after the zero crossing
+		delay = BurstFire(BURST_FIRE_PERCENT) ? ZERO_CROSS_DELAY_TICKS : DELAY_OFF;
+	}
+	else
+	#endif
+	{
+	#if USE_SPEED_CONTROL
+		delay = CalculateDelay(SpeedControlPercent);
+	#elif USE_LOOKUP_TABLE
+		delay = CalculateDelayFromTable(SetpointPercent);
+	#elif USE_DIP_SWITCH
+		delay = CalculateDelayFromDipSwitch(ReadDipSwitch());
+	#elif USE_SETPOINT_CACHE
+		delay = CalculateDelayCached(ADCResult);
+	#elif USE_HIGH_RESOLUTION
+		delay = CalculateDelayFromADC(ADCResult);
+	#else
+		delay = CalculateDelay(CalculateADCValue(ADCResult));
+	#endif
+	#if USE_SOFT_START
+		delay = SoftStart(delay);
+	#endif
+	#if USE_BOTH_EDGES || USE_ZERO_CROSS_CALIBRATION
+		delay = CompensateZeroCross(delay, positive);
+	#endif
+	}
+	ScheduleFiring(zeroCross, delay);
+	#if USE_PULSE_TRAIN
+	PulseTrainRemaining = PULSE_TRAIN_COUNT;
+		#if USE_PERIOD_MEASUREMENT
+	PulseTrainDeadline = zeroCross + HalfPeriodTicks - (ZERO_CROSS_DELAY_TICKS + PULSE_TRAIN_GAP_TICKS + PULSE_TRAIN_PULSE_TICKS);
+		#else
+	PulseTrainDeadline = zeroCross + (HALF_PERIOD_DURATION_TICKS - ZERO_CROSS_DELAY_TICKS - PULSE_TRAIN_GAP_TICKS - PULSE_TRAIN_PULSE_TICKS);
+		#endif
+	#endif
+	#if USE_SPEED_CONTROL
+	// The controller computes the power for the next half-period in the main loop
+	SpeedControlRequest = 1;
+	#endif
+	#if USE_TELEMETRY
+	TelemetryDelay = delay;
+	TelemetryDeadline = zeroCross + HalfPeriodTicks;
+	TelemetryHalfPeriods++;
+	#endif
+	#if USE_HW_OC0A
+	// The compare output may only be armed for the match in the last wrap of TCNT0
+	if ((delay != DELAY_OFF) && (TimebaseRemaining() < TIMEBASE_WRAP))
+	{
+		OC0A_SET_ON_MATCH;
+	}
+	#endif
+#else
+	#if USE_OVERCURRENT
+	if (OvercurrentBackoff)
+	{
+		// Backoff after an overcurrent trip
+		OvercurrentBackoff--;
+		SetWaitingTime(DELAY_OFF);
+		#if USE_SOFT_START
+		// Restart the ramp, the first firing after the backoff is at SOFT_START_MAX_DELAY
+		SoftStart(DELAY_OFF);
+		#endif
+	}
+	else
+	#endif
+	#if USE_BURST_FIRE
+	if (BURST_FIRE_SELECTED)
+	{
+		// Whole cycles, fired right after the zero crossing (same timing as 100%)
+		if (BurstFire(BURST_FIRE_PERCENT))
+		{
+			SetTimer(ZERO_CROSS_DELAY_PRESCALER, (char)ZERO_CROSS_DELAY_OCR0A);
+		}
+		else
+		{
+			SetWaitingTime(DELAY_OFF);
+		}
+	}
+	else
+	#endif
+	{
+	#if USE_LOOKUP_TABLE
+		SetWaitingPulseFromTable(SetpointPercent);
+	#elif USE_DIP_SWITCH
+		SetWaitingPulseFromDipSwitch(ReadDipSwitch());
+	#elif USE_HIGH_RESOLUTION || USE_SOFT_START || USE_BOTH_EDGES || USE_ZERO_CROSS_CALIBRATION || USE_SETPOINT_CACHE
+		#if USE_SETPOINT_CACHE
+		unsigned delay = CalculateDelayCached(ADCResult);
+		#elif USE_HIGH_RESOLUTION
+		unsigned delay = CalculateDelayFromADC(ADCResult);
+		#else
+		unsigned delay = CalculateDelay(CalculateADCValue(ADCResult));
+		#endif
+		#if USE_SOFT_START
+		delay = SoftStart(delay);
+		#endif
+		#if USE_BOTH_EDGES || USE_ZERO_CROSS_CALIBRATION
+		delay = CompensateZeroCross(delay, positive);
+		#endif
+		#if USE_SETPOINT_CACHE
+		// Unchanged delay = the prescaler and OCR0A of the last half-period are reused
+		SetWaitingTimeCached(delay);
+		#else
+		SetWaitingTime(delay);
+		#endif
+	#else
+		SetWaitingPulse(CalculateADCValue(ADCResult));
+	#endif
+	}
+	#if USE_HW_OC0A
+	// The timer is already armed with the new value, the next compare match sets PB0 exactly at the firing instant
+	OC0A_SET_ON_MATCH;
+	#endif
+#endif
 	state = WAITING_FOR_TRIGGER;
     // Change the detection variable – signals zero crossing in the main loop
     // Get a new value from the ADC (free running mode is not used to avoid continuous ADC ISR calls)
+#if USE_DIP_SWITCH
+	// No ADC conversions, the DIP switch is read directly
+#elif USE_ADC_NOISE_REDUCTION
+	ADCRequest = 1;
+#elif ADC_AUTO_TRIGGER == ADC_TRIGGER_TIMER0
+	// Only the low byte fits OCR0B, so the phase must be shorter than one wrap of TCNT0;
+	// OCF0B is not cleared by any ISR, so exactly one conversion is triggered per half-period
+	OCR0B = (unsigned char)(zeroCross + ADC_TRIGGER_PHASE_TICKS);
+	TIFR0 = (1 << OCF0B);
+#elif USE_OVERCURRENT
+	// The ADC is busy with the current sense, ADC_vect switches to the pot after the running conversion
+	ADCPotRequest = 1;
+#elif ADC_AUTO_TRIGGER == ADC_TRIGGER_SOFTWARE
 	ADCStart();
+#endif
 }
 
+/**
+ * @brief ISR for zero-cross detection (INT0; Timer1 input capture on the ATmega8).
+ * 
+ * Interrupt service routine executed on the rising edge of pin PB1 (i.e., at zero crossing of the mains voltage)
+ * On the ATmega8 the edge on PB0 (ICP1) has already been timestamped by the hardware in ICR1.
+ * With USE_BOTH_EDGES it is executed on both edges (detectors switching once per half-period).
+ * With USE_ZERO_CROSS_PLL the edge is only used when it comes within PLL_WINDOW_US of the predicted one,
+ * the half-period then starts at the phase filtered by ZeroCrossPll().
+ */
+ISR (HAL_ZERO_CROSS_vect) 
+{
+	INSTRUMENT_ISR_ENTER;
+#if USE_FREE_RUNNING_TIMER
+	// Capture the time of the zero-cross pulse first, all events of this half-period are relative to it
+	unsigned zeroCross = HAL_ZERO_CROSS_TIME();
+	#if USE_ZERO_CROSS_PLL
+	if (ZeroCrossPll(&zeroCross))
+	{
+		StartHalfPeriod(zeroCross);
+	}
+	#else
+	StartHalfPeriod(zeroCross);
+	#endif
+#else
+	StartHalfPeriod(0);
+#endif
+	INSTRUMENT_ISR_EXIT;
+}
+
+#if ADC_FILTER_SHIFT
+/// Sum of the conversions in the current half-period
+static unsigned ADCBlockSum = 0;
+/// Number of conversions in the current half-period
+static unsigned char ADCSampleCount = 0;
+#if ADC_AVERAGE_SHIFT
+/// Sums of the last ADC_AVERAGE_COUNT half-periods
+static unsigned ADCBlockRing[ADC_AVERAGE_COUNT];
+/// Oldest entry of ADCBlockRing
+static unsigned char ADCRingIndex = 0;
+/// Sum of all entries of ADCBlockRing
+static unsigned ADCRunningSum = 0;
+#endif
+#endif
+
 /**
  * @brief ISR for ADC conversion complete.
  * 
  * Interrupt service routine executed every time an ADC conversion completes on pin PB3 (ADC3)
  * 
+ * With ADC_OVERSAMPLING_SHIFT the next conversion is started right here until ADC_OVERSAMPLING_COUNT
+ * values are summed; with ADC_AVERAGE_SHIFT the sums of the last ADC_AVERAGE_COUNT half-periods
+ * are kept in a ring buffer with a running total. ADCResult is the rounded mean (0–1023).
+ *
+ * With USE_OVERCURRENT the conversions of the current sense are chained after the pot sample until the next
+ * half-period requests a new one. A value of OVERCURRENT_THRESHOLD or more cancels the pending trigger pulse
+ * (and the rest of a pulse train) and starts the backoff of OVERCURRENT_BACKOFF half-periods.
  */
 ISR (ADC_vect)
 {
+	INSTRUMENT_ISR_ENTER;
+#if USE_OVERCURRENT
+	if (ADCSensingCurrent)
+	{
+		if (ADC >= OVERCURRENT_THRESHOLD)
+		{
+			OvercurrentBackoff = OVERCURRENT_BACKOFF;
+			if (state == WAITING_FOR_TRIGGER)
+			{
+				// Cancel the trigger pulse of this half-period
+				TIMER_INT_OFF;
+			#if USE_HW_OC0A
+				OC0A_CLEAR_ON_MATCH;
+			#endif
+			}
+		#if USE_PULSE_TRAIN
+			// No further pulses of the train after the current one
+			PulseTrainRemaining = 1;
+		#endif
+		}
+		if (ADCPotRequest)
+		{
+			ADCPotRequest = 0;
+			ADCSensingCurrent = 0;
+			ADC_SELECT_POT;
+		}
+		ADCStart();
+		INSTRUMENT_ISR_EXIT;
+		return;
+	}
+#endif
 	// Read necessary values from ADCL and ADCH registers (note that the read order is important!! ADCL must be read first!)
+    // The 16-bit ADC register access reads ADCL first, without a volatile temporary on the stack
     // ADCResult ranges from 0 to 1023 (0-5V)
-	volatile int ADCTempResult = ADCL;
-	ADCResult = (ADCH << 8) + ADCTempResult;
+#if ADC_FILTER_SHIFT
+	ADCBlockSum += ADC;
+	#if ADC_OVERSAMPLING_SHIFT
+	if (++ADCSampleCount < ADC_OVERSAMPLING_COUNT)
+	{
+		// Chain the next conversion of this half-period
+		ADCStart();
+		INSTRUMENT_ISR_EXIT;
+		return;
+	}
+	ADCSampleCount = 0;
+	#endif
+	#if ADC_AVERAGE_SHIFT
+	// Replace the oldest sum in the ring buffer and update the running total
+	ADCRunningSum += ADCBlockSum - ADCBlockRing[ADCRingIndex];
+	ADCBlockRing[ADCRingIndex] = ADCBlockSum;
+	ADCRingIndex = (ADCRingIndex + 1) & (ADC_AVERAGE_COUNT - 1);
+	ADCResult = (ADCRunningSum + (1 << (ADC_FILTER_SHIFT - 1))) >> ADC_FILTER_SHIFT;
+	ADCSequence++;
+	#else
+	ADCResult = (ADCBlockSum + (1 << (ADC_FILTER_SHIFT - 1))) >> ADC_FILTER_SHIFT;
+	ADCSequence++;
+	#endif
+	ADCBlockSum = 0;
+#else
+	ADCResult = ADC;
+	ADCSequence++;
+#endif
+#if USE_OVERCURRENT
+	// Pot sampled, convert the current sense continuously until the next half-period
+	ADCSensingCurrent = 1;
+	ADC_SELECT_CURRENT;
+	ADCStart();
+#endif
+	INSTRUMENT_ISR_EXIT;
 }
 
 /**
@@ -77,19 +649,185 @@ ISR (ADC_vect)
  * 
  * - Generates triac trigger pulse.  
  * - Turns triac OFF after pulse duration.  
+ *
+ * With USE_HW_OC0A both edges of the pulse are made by the timer hardware, the ISR only prepares the next edge.
+ * With USE_FREE_RUNNING_TIMER the matches in the wraps of TCNT0 before the scheduled event are ignored.
+ * With USE_PULSE_TRAIN the end of a pulse goes back to WAITING_FOR_TRIGGER for the next pulse of the train
+ * until PULSE_TRAIN_COUNT pulses have been sent or the next one would not end before the zero crossing.
  */
-ISR (TIM0_COMPA_vect){
+ISR (HAL_TIMER_COMPA_vect){
+	INSTRUMENT_ISR_ENTER;
+#if USE_FREE_RUNNING_TIMER
+	unsigned remaining = TimebaseRemaining();
+	if ((int)remaining > 0)
+	{
+		// Compare match in an earlier wrap of TCNT0, the event is not due yet
+	#if USE_HW_OC0A
+		if (remaining < TIMEBASE_WRAP)
+		{
+			// The next match is the edge: the firing instant sets PB0, the end of the pulse clears it
+			if (state == WAITING_FOR_TRIGGER)
+			{
+				OC0A_SET_ON_MATCH;
+			}
+			else
+			{
+				OC0A_CLEAR_ON_MATCH;
+			}
+		}
+	#endif
+		INSTRUMENT_ISR_EXIT;
+		return;
+	}
+#endif
 	if(state == WAITING_FOR_TRIGGER)
 	{
 		// Here the the trigger pulse is set and state is changed  to SWITCHING
+	#if USE_HW_OC0A && !USE_FREE_RUNNING_TIMER
+		// PB0 has already been set by the compare match, the next match ends the pulse
+		OC0A_CLEAR_ON_MATCH;
+	#elif !USE_HW_OC0A
 		OPTOTRIAC_ON;
+	#endif
+		// Notch on the instrumentation pin (with USE_HW_OC0A it marks the ISR response, the PB0 edge came earlier)
+		INSTRUMENT_TRIGGER;
 		state = SWITCHING;
 		// Set trigger pulse timing
-		SetTimer(8, 149);
+	#if USE_FREE_RUNNING_TIMER
+		// The end of the pulse is relative to the scheduled firing instant, not to the ISR entry
+		#if USE_PULSE_TRAIN
+		TimebaseSchedule(TimebaseEvent + PULSE_TRAIN_PULSE_TICKS);
+		#else
+		TimebaseSchedule(TimebaseEvent + TRIGGER_PULSE_DURATION_TICKS);
+		#endif
+		#if USE_HW_OC0A
+		// PB0 has already been set by the compare match. A pulse longer than one wrap of TCNT0 is cleared by the match
+		// in its last wrap (armed above), until then the matches only set PB0 again
+		if (TimebaseRemaining() < TIMEBASE_WRAP)
+		{
+			OC0A_CLEAR_ON_MATCH;
+		}
+		#endif
+	#else
+		SetTimer(TRIGGER_PULSE_PRESCALER, (char)TRIGGER_PULSE_OCR0A);
+	#endif
 	}
 	else if (state == SWITCHING)
 	{
 		// Here the trigger pulse is turned off
+	#if !USE_HW_OC0A
 		OPTOTRIAC_OFF;
+	#endif
+	#if USE_PULSE_TRAIN
+		if (--PulseTrainRemaining && ((int)(PulseTrainDeadline - TimebaseEvent) >= 0))
+		{
+			// Next pulse after the gap, unless the train is complete or would reach the next zero crossing
+			state = WAITING_FOR_TRIGGER;
+			TimebaseSchedule(TimebaseEvent + PULSE_TRAIN_GAP_TICKS);
+		#if USE_HW_OC0A
+			// As for the pulse, a gap longer than one wrap of TCNT0 is armed in its last wrap
+			if (TimebaseRemaining() < TIMEBASE_WRAP)
+			{
+				OC0A_SET_ON_MATCH;
+			}
+		#endif
+			INSTRUMENT_ISR_EXIT;
+			return;
+		}
+	#endif
+	#if USE_FREE_RUNNING_TIMER
+		// Nothing more to do in this half-period, the timebase keeps running
+		TIMER_INT_OFF;
+	#elif USE_ADC_NOISE_REDUCTION
+		// Timer is not needed until the next zero cross, the main loop may start the ADC conversion
+		TIMER_INT_OFF;
+	#endif
+	}
+	INSTRUMENT_ISR_EXIT;
+}
+
+#if USE_FREE_RUNNING_TIMER && (HAL_TIMEBASE_BITS == 8)
+/**
+ * @brief ISR for Timer0 overflow.
+ * 
+ * Counts the wraps of TCNT0 (high byte of the free-running timebase).
+ * With USE_ZERO_CROSS_PLL it also starts the half-period when the expected zero-cross pulse has not come.
+ */
+ISR (TIM0_OVF_vect)
+{
+	INSTRUMENT_ISR_ENTER;
+	TimebaseHigh++;
+#if USE_ZERO_CROSS_PLL
+	// Coast through a missed zero-cross pulse on the predicted phase
+	unsigned zeroCross;
+	if (ZeroCrossPllTimeout(&zeroCross))
+	{
+		StartHalfPeriod(zeroCross);
 	}
-}
\ No newline at end of file
+#endif
+	INSTRUMENT_ISR_EXIT;
+}
+#endif
+
+#if USE_SPEED_CONTROL
+/**
+ * @brief ISR for the pin change interrupt of the tachometer pin.
+ * 
+ * Timestamps the rising edges of TACHO_PIN on the timebase. Intervals shorter than TACHO_MIN_PERIOD_TICKS
+ * (bounce, noise) are ignored; after a stop the first pulse only starts the measurement.
+ */
+ISR (PCINT0_vect)
+{
+	INSTRUMENT_ISR_ENTER;
+	if (PINB & (1 << TACHO_PIN))
+	{
+		unsigned now = TimebaseNow();
+		if (!TachoRunning)
+		{
+			TachoRunning = 1;
+			TachoLast = now;
+		}
+		else if ((now - TachoLast) >= TACHO_MIN_PERIOD_TICKS)
+		{
+			TachoPeriod = now - TachoLast;
+			TachoLast = now;
+		}
+	}
+	INSTRUMENT_ISR_EXIT;
+}
+#endif
+
+#if USE_TELEMETRY
+/**
+ * @brief ISR for Timer0 Compare Match B.
+ * 
+ * Outputs the next bit of the telemetry UART and schedules the following edge.
+ * The match after the stop bit ends the byte.
+ */
+ISR (HAL_TIMER_COMPB_vect)
+{
+	INSTRUMENT_ISR_ENTER;
+	if (TelemetryBit == TELEMETRY_BYTE_BITS)
+	{
+		// End of the stop bit
+		HAL_TIMER_TIMSK &= ~(1 << HAL_TIMER_OCIEB);
+		TelemetryIndex++;
+	}
+	else
+	{
+		if (TelemetryShift & 1)
+		{
+			TELEMETRY_HIGH;
+		}
+		else
+		{
+			TELEMETRY_LOW;
+		}
+		TelemetryShift >>= 1;
+		TelemetryBit++;
+		TelemetryBitTime += TELEMETRY_BIT_TICKS_Q4;
+		HAL_TIMER_OCRB = HAL_TIMER_COMPARE(TelemetryByteStart + ((TelemetryBitTime + 8) >> 4));
+	}
+	INSTRUMENT_ISR_EXIT;
+}
+#endif
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025, Michal Chvatal
+# All rights reserved.
+#
+# This source code is licensed under the BSD 3-Clause License found in the
+# LICENSE file in the root directory of this source tree.
+
+"""
+Flash/SRAM/cycle budget report of the firmware (make budget in sim/).
+
+Reported are the flash size (.text + .data) and the static RAM (.data + .bss + .noinit) from avr-size,
+the flash and RAM size of every function and variable from avr-nm, and the ISR cycle counts and
+the maximal stack depth measured by the simavr profiler (sim/profile.c). The SRAM budget covers
+the static RAM and the stack together. The exit code is 1 when any budget is exceeded, or when the
+avr-size or profiler output has no results (so that a failed or changed tool cannot pass the check).
+
+Usage: budget.py [--size avr-size] [--nm avr-nm] [--flash bytes] [--ram bytes] [--isr-cycles cycles]
+                 firmware.elf [profile_output.txt]
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+FLASH_SECTIONS = (".text", ".data")
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+
+
+def sections(size_tool, elf):
+    """Section sizes from avr-size -A."""
+    result = {}
+    output = subprocess.run([size_tool, "-A", elf], check=True, capture_output=True, text=True).stdout
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[0].startswith(".") and fields[1].isdigit():
+            result[fields[0]] = int(fields[1])
+    return result
+
+
+def symbols(nm_tool, elf):
+    """Functions and variables (name, size) from avr-nm, largest first."""
+    functions, variables = [], []
+    output = subprocess.run([nm_tool, "--size-sort", "-S", elf], check=True, capture_output=True, text=True).stdout
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        size, kind, name = int(fields[1], 16), fields[2], fields[3]
+        if kind in "Tt":
+            functions.append((name, size))
+        elif kind in "DdBb":
+            variables.append((name, size))
+    functions.sort(key=lambda entry: -entry[1])
+    variables.sort(key=lambda entry: -entry[1])
+    return functions, variables
+
+
+def profile(file):
+    """ISR cycle counts {name: (count, max)} and the stack depth from the output of sim/profile."""
+    isrs, stack = {}, None
+    with open(file) as output:
+        for line in output:
+            match = re.match(r"\s+(\w+_vect)\s+(\d+)\s+(\d+)\s+([\d.]+)\s+(\d+)", line)
+            if match:
+                isrs[match.group(1)] = (int(match.group(2)), int(match.group(5)))
+                continue
+            match = re.match(r"# stack: max depth (\d+) bytes", line)
+            if match:
+                stack = int(match.group(1))
+    return isrs, stack
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flash/SRAM/cycle budget report of the firmware")
+    parser.add_argument("--size", default="avr-size")
+    parser.add_argument("--nm", default="avr-nm")
+    parser.add_argument("--flash", type=int, default=1024, help="flash budget [bytes]")
+    parser.add_argument("--ram", type=int, default=64, help="SRAM budget, static data and stack [bytes]")
+    parser.add_argument("--isr-cycles", type=int, default=2400, help="cycle budget of every ISR")
+    parser.add_argument("elf")
+    parser.add_argument("profile", nargs="?")
+    args = parser.parse_args()
+
+    sizes = sections(args.size, args.elf)
+    flash = sum(sizes.get(name, 0) for name in FLASH_SECTIONS)
+    ram = sum(sizes.get(name, 0) for name in RAM_SECTIONS)
+    functions, variables = symbols(args.nm, args.elf)
+    isrs, stack = profile(args.profile) if args.profile else ({}, None)
+    failures = []
+    if ".text" not in sizes:
+        failures.append("no .text section in the %s output" % args.size)
+    if args.profile:
+        # A profile without results (the simulation did not run, changed output format) must not pass
+        if not any(count for count, longest in isrs.values()):
+            failures.append("no ISR cycle counts in %s" % args.profile)
+        if stack is None:
+            failures.append("no stack depth in %s" % args.profile)
+
+    print("# flash %d of %d bytes" % (flash, args.flash))
+    for name, size in functions:
+        print("  %-32s %5d" % (name, size))
+    if flash > args.flash:
+        failures.append("flash %d bytes over budget %d" % (flash, args.flash))
+
+    used = ram + (stack or 0)
+    print("# SRAM %d of %d bytes: static %d, stack %s" % (used, args.ram, ram, "-" if stack is None else stack))
+    for name, size in variables:
+        print("  %-32s %5d" % (name, size))
+    if used > args.ram:
+        failures.append("SRAM %d bytes over budget %d" % (used, args.ram))
+
+    if isrs:
+        print("# ISR cycles, budget %d" % args.isr_cycles)
+        for name, (count, longest) in sorted(isrs.items()):
+            print("  %-32s %5d (%d calls)" % (name, longest, count))
+            if longest > args.isr_cycles:
+                failures.append("%s %d cycles over budget %d" % (name, longest, args.isr_cycles))
+
+    for failure in failures:
+        print("Budget check failed: " + failure, file=sys.stderr)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
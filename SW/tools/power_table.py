@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025, Michal Chvatal
+# All rights reserved.
+#
+# This source code is licensed under the BSD 3-Clause License found in the
+# LICENSE file in the root directory of this source tree.
+
+"""
+Generate inc/power_table.h, the equal-power firing table (USE_EQUAL_POWER).
+
+For a resistive load fired at the angle a (0..pi) of every half-period the delivered power is
+    P(a) = 1 - a / pi + sin(2 a) / (2 pi)
+of the full-wave power. For every setpoint 1..100 % the angle with P(a) = setpoint / 100 is found
+and stored as the conduction time (1 - a / pi) in 1/10000 of the half-period.
+
+Usage: power_table.py [output]   (default: ../inc/power_table.h relative to this script)
+"""
+
+import math
+import os
+import sys
+
+SCALE = 10000
+
+
+def power(angle):
+    return 1.0 - angle / math.pi + math.sin(2.0 * angle) / (2.0 * math.pi)
+
+
+def firing_angle(fraction):
+    # P(a) is monotonically decreasing on 0..pi
+    low, high = 0.0, math.pi
+    for _ in range(60):
+        middle = (low + high) / 2.0
+        if power(middle) > fraction:
+            low = middle
+        else:
+            high = middle
+    return (low + high) / 2.0
+
+
+def main():
+    output = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "inc", "power_table.h")
+    entries = []
+    for percent in range(1, 101):
+        conduction = 1.0 - firing_angle(percent / 100.0) / math.pi
+        entries.append("ENTRY(%d, %d)" % (percent, round(conduction * SCALE)))
+
+    lines = [
+        "/*",
+        " * Copyright (c) 2025, Michal Chvatal",
+        " * All rights reserved.",
+        " *",
+        " * This source code is licensed under the BSD 3-Clause License found in the",
+        " * LICENSE file in the root directory of this source tree.",
+        " */ ",
+        "",
+        "/*",
+        " * Generated by tools/power_table.py, do not edit.",
+        " *",
+        " * Conduction time giving equal steps of the delivered power (resistive load) for every setpoint 1–100%,",
+        " * in 1/%d of the half period: ENTRY(percent, conduction)" % SCALE,
+        " */",
+        "",
+        "#ifndef POWER_TABLE_H_",
+        "#define POWER_TABLE_H_",
+        "\t#define EQUAL_POWER_SCALE %d" % SCALE,
+        "",
+        "\t#define EQUAL_POWER_TABLE(ENTRY) \\",
+    ]
+    for i in range(0, len(entries), 10):
+        row = " ".join(entries[i:i + 10])
+        lines.append("\t\t" + row + (" \\" if i + 10 < len(entries) else ""))
+    lines += ["#endif /* POWER_TABLE_H_ */", ""]
+    with open(output, "w") as file:
+        file.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()